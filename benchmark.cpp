@@ -0,0 +1,48 @@
+#include "reporter.hpp"
+#include <chrono>
+#include <random>
+
+// Compares `reporter::sortByLocation` against `std::sort` with a comparator which calls `SourceFile::str()`.
+// Build with: g++ -O2 -std=c++11 benchmark.cpp -o benchmark
+
+int main(int argc, char** argv) {
+    size_t count = argc > 1 ? std::stoul(argv[1]) : 1000000;
+
+    std::vector<reporter::SimpleFile> files;
+    for (int i = 0; i < 200; i++)
+        files.emplace_back("src/module" + std::to_string(i) + ".dn");
+
+    std::mt19937 rng(42);
+    auto random = [&](uint32_t max) { return static_cast<uint32_t>(rng() % max); };
+    std::vector<reporter::Diagnostic> diags;
+    diags.reserve(count);
+    for (size_t i = 0; i < count; i++)
+        diags.push_back(reporter::Error("an error", { random(5000) + 1, random(120), &files[random(200)] }));
+    auto copy = diags;
+
+    auto start = std::chrono::steady_clock::now();
+    std::stable_sort(copy.begin(), copy.end(), [](const reporter::Diagnostic& a, const reporter::Diagnostic& b) {
+        auto& x = a.location();
+        auto& y = b.location();
+        if (x.file != y.file)
+            return x.file->str() < y.file->str();
+        if (x.line != y.line)
+            return x.line < y.line;
+        return x.start < y.start;
+    });
+    auto mid = std::chrono::steady_clock::now();
+    reporter::sortByLocation(diags);
+    auto end = std::chrono::steady_clock::now();
+
+    for (size_t i = 0; i < count; i++)
+        if (diags[i].location().file != copy[i].location().file || diags[i].location().line != copy[i].location().line
+         || diags[i].location().start != copy[i].location().start) {
+            std::cerr << "mismatch at " << i << "\n";
+            return 1;
+        }
+
+    std::cout << count << " diagnostics:\n"
+              << "  std::stable_sort: " << std::chrono::duration_cast<std::chrono::milliseconds>(mid - start).count() << "ms\n"
+              << "  sortByLocation:   " << std::chrono::duration_cast<std::chrono::milliseconds>(end - mid).count() << "ms\n";
+    return 0;
+}
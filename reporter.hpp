@@ -75,6 +75,7 @@
 #include <atomic>
 #include <cstdlib>
 #include <cstring>
+#include <cerrno>
 #include <iostream>
 
 namespace rang {
@@ -556,6 +557,28 @@ inline void setControlMode(const control value) noexcept
 #include <vector>
 #include <fstream>
 #include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <limits>
+#include <memory>
+#include <iterator>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <functional>
+#include <unordered_map>
+#include <deque>
+#include <condition_variable>
+#include <cstring>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define REPORTER_POSIX
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 /**
  * A simple implementation for pretty error diagnostics.
@@ -643,7 +666,10 @@ namespace reporter {
                        _attributes == color._attributes;
             }
 
-            void print(std::ostream& out, std::string str) const {
+            /**
+             * Switch `out` to this color, without resetting it afterwards.
+             */
+            void begin(std::ostream& out) const {
                 if (_attributes & attributes::bold)      out << rang::style::bold;
                 if (_attributes & attributes::weak)      out << rang::style::dim;
                 if (_attributes & attributes::italic)    out << rang::style::italic;
@@ -652,6 +678,10 @@ namespace reporter {
                 if (_attributes & attributes::reverse)   out << rang::style::reversed;
                 if (_fg != rang::fg::none) out << _fg;
                 if (_bg != rang::bg::none) out << _bg;
+            }
+
+            void print(std::ostream& out, std::string str) const {
+                begin(out);
                 out << str << rang::style::reset;
             }
         };
@@ -686,29 +716,220 @@ namespace reporter {
 
     /////////////////////////////////////////////////////////////////////////
 
+    /**
+     * A colored part of a line of source code, from `start` to (and excluding) `end`.
+     */
+    struct HighlightSpan {
+        uint32_t start;
+        uint32_t end;
+        colors::Color color;
+    };
+
+    /**
+     * Abstract class which tokenizes lines of source code for syntax highlighting.
+     * Set `Config::highlighter` to use one. Each line is only highlighted once per file (see `SourceFile::Index::highlight`).
+     */
+    class Highlighter {
+    public:
+        virtual ~Highlighter() {}
+
+        /**
+         * @param line a line of source code.
+         * @return the colored parts of the line, in order and non-overlapping. Any part of the line which isn't covered is printed uncolored.
+         */
+        virtual std::vector<HighlightSpan> highlight(const std::string& line) = 0;
+    };
+
+    /////////////////////////////////////////////////////////////////////////
+
     /**
      * Abstract class which represents a source file.
      * Class contains only one member, 'str()', which is opened and displayed by the reporter
      */
     class SourceFile {
     public: 
+        /**
+         * The contents of a file, along with the offset of each line.
+         * Built once per file, the first time a line of the file is needed.
+         */
+        class Index {
+        private:
+            /* lines `first` to `last` (inclusive) allow diagnostics with error code `code` */
+            struct Suppression {
+                uint32_t first;
+                uint32_t last;
+                std::string code;
+
+                bool operator<(const Suppression& other) const { return first < other.first; }
+            };
+
+            std::string _contents;
+            std::vector<size_t> _lines; // offset of the start of each line, followed by the size of the file
+            std::vector<Suppression> _suppressions; // sorted by first line
+
+            mutable std::mutex _highlightMutex;
+            mutable Highlighter* _highlighter = nullptr; // the highlighter `_highlights` were computed by
+            mutable std::unordered_map<uint32_t, std::vector<HighlightSpan>> _highlights; // by line
+
+            /* find every `reporter: allow(CODE, ...)` marker, each allows its own line and the one after it */
+            void scanSuppressions() {
+                static const std::string marker = "reporter: allow(";
+                for (size_t i = _contents.find(marker); i != std::string::npos; i = _contents.find(marker, i + 1)) {
+                    auto line = static_cast<uint32_t>(std::upper_bound(_lines.begin(), _lines.end(), i) - _lines.begin());
+                    auto end = _contents.find_first_of(")\n", i);
+                    if (end == std::string::npos || _contents[end] != ')')
+                        continue;
+                    std::string code;
+                    for (auto j = i + marker.size(); j <= end; j++) {
+                        if (_contents[j] == ',' || _contents[j] == ')') {
+                            if (code != "")
+                                _suppressions.push_back({ line, line + 1, code });
+                            code.clear();
+                        } else if (!std::isspace(static_cast<unsigned char>(_contents[j])))
+                            code += _contents[j];
+                    }
+                }
+                std::stable_sort(_suppressions.begin(), _suppressions.end());
+            }
+
+        public:
+            /**
+             * @param contents the whole contents of the file.
+             */
+            Index(std::string contents) : _contents(std::move(contents)) {
+                _lines.push_back(0);
+                for (size_t i = _contents.find('\n'); i != std::string::npos; i = _contents.find('\n', i + 1))
+                    _lines.push_back(i + 1);
+                _lines.push_back(_contents.size() + 1);
+                scanSuppressions();
+            }
+
+            /**
+             * @return whether a `reporter: allow(code)` comment on `line` or on the line above it allows diagnostics with error code `code`.
+             */
+            bool allows(const std::string& code, uint32_t line) const {
+                // markers cover at most two lines, so only markers starting on `line` or the line before it can cover it
+                auto it = std::upper_bound(_suppressions.begin(), _suppressions.end(), Suppression { line, line, "" });
+                while (it != _suppressions.begin() && (--it)->first + 1 >= line)
+                    if (it->last >= line && it->code == code)
+                        return true;
+                return false;
+            }
+
+            /** @return the whole contents of the file. */
+            const std::string& contents() const { return _contents; }
+
+            /** @return number of lines in the file. */
+            uint32_t lineCount() const { return static_cast<uint32_t>(_lines.size() - 1); }
+
+            /** @return offset of the first character of `line` in `contents()` (line count starts at 1), or the size of the file if it has no such line. */
+            size_t offset(uint32_t line) const { return line == 0 || line > lineCount() ? _contents.size() : _lines[line - 1]; }
+
+            /**
+             * Get a specific line without copying it.
+             * @param line line in the file (line count starts at 1).
+             * @param size set to the size of the line, excluding the newline.
+             * @return pointer to the first character of the line, or nullptr if the file has no such line.
+             */
+            const char* line(uint32_t line, size_t& size) const {
+                if (line == 0 || line > lineCount())
+                    return nullptr;
+                size = _lines[line] - _lines[line - 1] - 1;
+                return _contents.data() + _lines[line - 1];
+            }
+
+            /**
+             * Highlight a line, or get the highlighting from the last time the line was highlighted.
+             * The cache belongs to the index, so it is dropped along with it when the file is reloaded.
+             * @param highlighter the highlighter to use.
+             * @param line line in the file (line count starts at 1).
+             */
+            std::vector<HighlightSpan> highlight(Highlighter& highlighter, uint32_t line) const {
+                {
+                    std::lock_guard<std::mutex> lock(_highlightMutex);
+                    if (_highlighter != &highlighter) {
+                        _highlights.clear();
+                        _highlighter = &highlighter;
+                    }
+                    auto found = _highlights.find(line);
+                    if (found != _highlights.end())
+                        return found->second;
+                }
+                auto spans = highlighter.highlight(this->line(line));
+                std::lock_guard<std::mutex> lock(_highlightMutex);
+                if (_highlighter == &highlighter)
+                    _highlights[line] = spans;
+                return spans;
+            }
+
+            /** @return a specific line, or an empty string if the file has no such line (line count starts at 1). */
+            std::string line(uint32_t line) const {
+                size_t size = 0;
+                auto data = this->line(line, size);
+                return data ? std::string(data, size) : "";
+            }
+        };
+
         /**
          * @return file path to be opened and dispayed by the reporter.
+         * Must be thread safe if `Config::readThreads` is more than 1.
          */
         virtual std::string str() = 0;
 
         virtual ~SourceFile() {}
 
-        /* get a specific line from the file */
+        /**
+         * @return a specific line of the file, by default from its index.
+         * To give the reporter contents other than the file on disk (e.g. an editor's unsaved buffer), override `read()` rather than
+         * this function: allow comments, baseline fingerprints, syntax highlighting and fix-its are all taken from the index, which is
+         * built from `read()`, so a file whose lines are only overridden here is printed one way but checked and edited another.
+         */
         virtual std::string getLine(uint32_t line) {
-            std::fstream file(str());
-            file.seekg(std::ios::beg);
-            for (uint32_t i=0; i < line - 1; ++i)
-                file.ignore(std::numeric_limits<std::streamsize>::max(),'\n');
-            std::string ret;
-            std::getline(file, ret);
-            return ret;
+            return index()->line(line);
+        }
+
+        /**
+         * @return the file's index, reading the file if this is the first time it is needed.
+         * The index stays valid for as long as it is held, even if the file is reloaded in the meantime.
+         */
+        std::shared_ptr<const Index> index() {
+            auto idx = std::atomic_load(&_index);
+            if (!idx) {
+                std::shared_ptr<const Index> built = std::make_shared<Index>(read());
+                // if another thread built the index first, use theirs
+                if (!std::atomic_compare_exchange_strong(&_index, &idx, built))
+                    return idx;
+                idx = built;
+            }
+            return idx;
         }
+
+        /**
+         * Drop the file's index, so the file is read again the next time it is needed.
+         * Must not be called while the file is being rendered.
+         */
+        void reload() {
+            std::atomic_store(&_index, std::shared_ptr<const Index>());
+        }
+
+        /** @return whether the file was already read, so that its index is available without any I/O. */
+        bool indexed() const {
+            return std::atomic_load(&_index) != nullptr;
+        }
+
+    protected:
+        /**
+         * @return the contents of the file, by default opens `str()` and reads it.
+         * This is the one function to override for a file whose contents don't come from disk (see `getLine()`).
+         * Must be thread safe if `Config::readThreads` is more than 1, since different files are then read at once.
+         */
+        virtual std::string read() {
+            std::ifstream file(str(), std::ios::binary);
+            return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        }
+
+    private:
+        std::shared_ptr<const Index> _index;
     };
 
     /**
@@ -781,913 +1002,4148 @@ namespace reporter {
          */
         Location() : Location(0, 0, 0, nullptr) {}
 
-        bool operator==(Location& other) { 
+        bool operator==(const Location& other) const { 
             return other.file == file && other.start == start &&
                    other.line == line && other.end  == end; 
         }
-        bool operator!=(Location& other) { 
+        bool operator!=(const Location& other) const { 
             return !operator==(other);
         }
     };
 
     /**
-     * RICH:
-     *     Error(E308): a rich error
-     *        ╭─ test.cpp ─╴
-     *        │ 
-     *      4 │     int n = 10;
-     *        │     ^^^ a submessage
-     *     ───╯
-     * 
-     * SHORT:
-     *     test.cpp:4:4:7: Error(E308): a rich error
+     * A suggested edit: replace the source code at `loc` with `replacement`.
      */
-    enum class DisplayStyle { RICH, SHORT };
+    struct FixIt {
+        Location loc;
+        std::string replacement;
+    };
 
     /**
-     * You can customize most aspects of the display settings such as color, padding, used characters, etc.
-     * Simply create a Config object, change the values to your liking, and pass them to the print() function.
+     * Maps ranges of lines in generated files to the files they were generated from.
+     * The mappings are sorted once on construction, and each location is translated with a binary search.
      */
-    class Config {
+    class SourceMap {
     public:
+        /**
+         * `lineCount` lines starting at `line` in `generated` were generated from the same number of lines starting at `originLine` in `origin`,
+         * with every column shifted by `columnDelta`.
+         */
+        struct Mapping {
+            SourceFile* generated;
+            uint32_t line;
+            uint32_t lineCount;
+            SourceFile* origin;
+            uint32_t originLine;
+            int32_t columnDelta;
+
+            bool operator<(const Mapping& other) const {
+                return generated != other.generated ? std::less<SourceFile*>()(generated, other.generated) : line < other.line;
+            }
+        };
 
-        /* Contrls whether the diagnostics are displayed in RICH or SHORT mode, default is RICH */
-        DisplayStyle style;
-
-        /* Number of spaces to render per tab */
-        uint32_t tabWidth;
+    private:
+        std::vector<Mapping> mappings; // sorted, non-overlapping
 
-        /* The colors to be displayed for each type of diagnostic, as well as some general color settings */
-        struct {
-            colors::Color error = colors::fgred & colors::bold;
-            colors::Color warning = colors::fgyellow & colors::bold;
-            colors::Color note = colors::fgblack & colors::bold;
-            colors::Color help = colors::fgblue & colors::bold;
-            colors::Color message = colors::bold; // the color of the main error message
-            colors::Color border = colors::inherit;
-            colors::Color lineNum = colors::inherit;
-            colors::Color highlightLineNum = colors::inherit;
-        } colors;
+    public:
+        SourceMap() {}
 
-        /* padding is empty space which is added to make the diagnostics more readable */
-        struct {
-            /*
-                    ╭─ file.xyz ─
-                    │ ┐
-                    │ ├─ borderTop
-                    │ ┘
-               17   │   int n = 20
-            └┬┘  └┬┘│└┬┘
-             │    │ │ ╰ borderLeft
-             │    ╰ afterLineNum
-             ╰ beforeLineNum
-                    │ ┐
-                    │ ├─ borderBottom
-                    │ ┘
-                 ───╯
-            */
-            uint8_t beforeLineNum = 1;
-            uint8_t afterLineNum = 1;
-            uint8_t borderTop = 1;
-            uint8_t borderLeft = 1;
-            uint8_t borderBottom = 0;
-        } padding;
+        /**
+         * @param ranges the mappings, in any order. Ranges of the same generated file must not overlap.
+         */
+        SourceMap(std::vector<Mapping> ranges) : mappings(std::move(ranges)) {
+            std::sort(mappings.begin(), mappings.end());
+        }
 
-        /** 
-         * Controls all the characters which are to be rendered. 
-         * Note: some of these are stored as strings, while others are stored as single characters.
+        /**
+         * Move a location in generated code to its origin.
+         * @param loc the location, replaced with its origin if it has one.
+         * @return whether the location is in generated code.
          */
-        struct {
-            std::string errorName = "Error";
-            std::string warningName = "Warning";
-            std::string noteName = "Note";
-            std::string helpName = "Help";
-            std::string internalErrorName = "Internal Error";
+        bool translate(Location& loc) const {
+            if (!loc.file) return false;
+            auto it = std::upper_bound(mappings.begin(), mappings.end(), Mapping { loc.file, loc.line, 0, nullptr, 0, 0 });
+            if (it == mappings.begin()) return false;
+            auto& m = *--it;
+            if (m.generated != loc.file || loc.line >= m.line + m.lineCount) return false;
+            auto shift = [&m](uint32_t col) { return static_cast<uint32_t>(std::max<int64_t>(0, static_cast<int64_t>(col) + m.columnDelta)); };
+            loc = Location(m.originLine + (loc.line - m.line), shift(loc.start), shift(loc.end), m.origin);
+            return true;
+        }
 
-            std::string shortModeLineSeperator = " / "; // seperates multi-line diagnostic messages
+        /** @return number of mappings. */
+        size_t size() const { return mappings.size(); }
+    };
 
-            wchar_t errCodeBracketLeft  = L'(';
-            wchar_t errCodeBracketRight = L')';
+    /**
+     * A diagnostic message with `{}` slots, such as "expected type '{}' but found '{}'".
+     * The template is split into its literal parts once, and diagnostics made from it only store their arguments -
+     * the message is written straight into the output when the diagnostic is printed, without formatting it into a string first.
+     * Templates are usually declared once, as static or global variables, and must outlive the diagnostics made from them.
+     */
+    class MessageTemplate {
+    private:
+        std::string _text;
+        std::vector<std::string> literals; // the parts between the slots, one more than the number of slots
 
-            std::string beforeFileName  = "╭─ ";
-            std::string afterFileName   = " ─╴";
+    public:
+        /**
+         * @param text the template, each `{}` is a slot for an argument.
+         */
+        explicit MessageTemplate(std::string text) : _text(std::move(text)) {
+            size_t prev = 0;
+            for (size_t pos = _text.find("{}"); pos != std::string::npos; pos = _text.find("{}", prev)) {
+                literals.push_back(_text.substr(prev, pos - prev));
+                prev = pos + 2;
+            }
+            literals.push_back(_text.substr(prev));
+        }
 
-            wchar_t borderVertical      = L'│';
-            wchar_t borderHorizontal    = L'─';
-            wchar_t borderBottomRight   = L'╯';
-            wchar_t noteBullet          = L'•';
+        /**
+         * Count the slots of a template at compile time, e.g. `static_assert(MessageTemplate::countSlots("{} vs {}") == 2, "")`.
+         */
+        static constexpr size_t countSlots(const char* text) {
+            return *text == '\0' ? 0 : (text[0] == '{' && text[1] == '}') ? 1 + countSlots(text + 2) : countSlots(text + 1);
+        }
 
-            wchar_t lineVertical        = L'│';
-            std::string lineBottomLeft  = "╰ ";
+        /** @return the template as it was written. */
+        const std::string& text() const { return _text; }
 
-            wchar_t arrowDown           = L'v';
-            wchar_t arrowUp             = L'^';
-            wchar_t underline1          = L'~';
-            wchar_t underline2          = L'=';
-            wchar_t underline3          = L'#';
-            wchar_t underline4          = L'*';
-            wchar_t underlineA          = L'-';
-            wchar_t underlineB          = L'+';
-        } chars;
+        /** @return number of slots in the template. */
+        size_t slots() const { return literals.size() - 1; }
 
-        Config() : style(DisplayStyle::RICH), tabWidth(4) { }
+        /**
+         * Write the message with its slots filled in. Missing arguments are left empty.
+         */
+        void write(std::ostream& out, const std::vector<std::string>& args) const {
+            for (size_t i = 0; i < literals.size(); i++) {
+                out << literals[i];
+                if (i < args.size() && i + 1 < literals.size())
+                    out << args[i];
+            }
+        }
+
+        /**
+         * @return the message with its slots filled in.
+         */
+        std::string format(const std::vector<std::string>& args) const {
+            std::string ret;
+            for (size_t i = 0; i < literals.size(); i++) {
+                ret += literals[i];
+                if (i < args.size() && i + 1 < literals.size())
+                    ret += args[i];
+            }
+            return ret;
+        }
     };
 
     /**
-     * These are all the parts which are rendered by `print`:
-     *
-     *      header╶─╴│ Error(E308): a complex error
-     *         top╶─╴│   ╭─ example.cpp ─╴
-     *               │   │ 
-     *     snippet╶─╴│ 1 │ #include "reporter.hpp"
-     *   secondary╶─╴│   │ ~~~~~~~~ a relevant include
-     *     padding╶─╴│ 2 │ 
-     *     snippet╶─╴│ 3 │ int main() {
-     *   secondary╶─╴│   │            ~ curly brace
-     *     padding╶─╴│ ⋯
-     *  subMessage╶─╴│   │          this is where the error is, hence the bold red
-     *               │   │          vvvv
-     *     snippet╶─╴│ 7 │     auto file = new reporter::SimpleFile("example.cpp");
-     *             ┌╴│   │     ~~~~ ~~~~ ~               ~~~~~~~~~~                
-     *             │ │   │     │    │    │               ╰ a help message
-     * secondaries╶┤ │   │     │    │    ╰ assignment
-     *             │ │   │     │    ╰ a variable
-     *             └╴│   │     ╰ a type
-     *      bottom╶─╴│───╯
-     *   secondary╶─╴│     • Help: a general help message,
-     *               │             not set to any specific location
+     * Text with styled spans, such as the identifiers and types inside a message, written with a small markup:
+     * `code` and *emphasis*, where a backslash escapes the next character.
+     * The markup is parsed once, into the plain text and a list of spans, so everything which measures or compares the text
+     * (alignment, SHORT output, hashes) never sees the styling - it is only lowered when written, to escape codes or to HTML tags.
      */
-    class Diagnostic {
+    class StyledText {
+    public:
+        enum class Style : uint8_t { CODE, EMPHASIS };
+
+        /* a styled part of the text, by byte offsets into `text()`, the rest of the text is plain */
+        struct Span {
+            uint32_t start;
+            uint32_t end;
+            Style style;
+        };
+
     private:
-        std::string msg;
-        std::string subMsg;
-        Location loc;
-        DiagnosticType errTy;
-        std::string code;
-        std::vector<Diagnostic> secondaries;
+        std::string _text;
+        std::vector<Span> _spans; // in order, never overlapping
 
-        /* count number of utf8 characters in a string, if invalid character is found returns std::string::npos. */
-        static size_t countChars(std::string str) {
-            #define MSB (1 << 7)
-            size_t sum = 0;
-            for (size_t i = 0; i < str.size(); i++) {
-                char c = str[i];
-                if (c & MSB) {
-                    c <<= 1;
-                    if ((c & MSB) == 0)
-                        return std::string::npos;
-                    do {
-                        i++;
-                        c <<= 1;
-                    } while (c & MSB);
-                }
-                sum++;
+    public:
+        StyledText() = default;
+
+    private:
+        /* the position of the delimiter closing the one at `open`, or npos if it isn't closed */
+        static size_t closing(const std::string& markup, size_t open) {
+            char c = markup[open];
+            // "a * b" and "int*" aren't emphasis, an opening asterisk must be followed by text
+            if (c == '*' && (open + 1 >= markup.size() || std::isspace(static_cast<unsigned char>(markup[open + 1]))))
+                return std::string::npos;
+            for (size_t i = open + 1; i < markup.size(); i++) {
+                if (markup[i] == '\\')
+                    i++;
+                else if (markup[i] == c && (c == '`' || !std::isspace(static_cast<unsigned char>(markup[i - 1]))))
+                    return i;
             }
-            return sum;
-            #undef MSB
+            return std::string::npos;
         }
 
-        /* unicode code point to string */
-        static std::string toString(char32_t cp)
-        {
-            uint8_t c[5] = { 0 };
-            if      (cp<=0x7F) { c[0] = static_cast<uint8_t>(cp); } 
-            else if (cp<=0x7FF) { c[0] = static_cast<uint8_t>((cp>>6)+192); c[1] = static_cast<uint8_t>((cp&63)+128); }
-            else if (0xd800<=cp && cp<=0xdfff) { /*invalid block of utf8*/ } 
-            else if (cp <= 0xFFFF)   { 
-                c[0] = static_cast<uint8_t>((cp>>12)+224);
-                c[1] = static_cast<uint8_t>(((cp>>6)&63)+128);
-                c[2] = static_cast<uint8_t>((cp&63)+128); 
-            } 
-            else if (cp <= 0x10FFFF) { 
-                c[0] = static_cast<uint8_t>((cp>>18)+240);
-                c[1] = static_cast<uint8_t>(((cp>>12)&63)+128); 
-                c[2] = static_cast<uint8_t>(((cp>>6)&63)+128);
-                c[3] = static_cast<uint8_t>((cp&63)+128); }
-            return std::string(reinterpret_cast<char*>(c));
+    public:
+        /**
+         * @param markup the text, `code` and *emphasis* are styled. A delimiter which isn't closed, or an asterisk
+         *               followed by a space, is kept as it is. A backslash escapes the character after it.
+         */
+        explicit StyledText(const std::string& markup) {
+            for (size_t i = 0; i < markup.size(); i++) {
+                char c = markup[i];
+                size_t close;
+                if (c == '\\' && i + 1 < markup.size())
+                    _text += markup[++i];
+                else if ((c == '`' || c == '*') && (close = closing(markup, i)) != std::string::npos) {
+                    auto start = static_cast<uint32_t>(_text.size());
+                    for (i++; i < close; i++) {
+                        if (markup[i] == '\\' && i + 1 < close)
+                            i++;
+                        _text += markup[i];
+                    }
+                    if (_text.size() > start)
+                        _spans.push_back({ start, static_cast<uint32_t>(_text.size()), c == '`' ? Style::CODE : Style::EMPHASIS });
+                } else _text += c;
+            }
         }
 
-        /* repeat `s` `n` times */
-        static std::string repeat(std::string s, size_t n) 
-        { 
-            std::string s1 = s; 
-            for (size_t i=1; i<n;i++)  s += s1;
-            return s; 
-        }
+        /**
+         * Constructs styled text from parts which were already parsed.
+         * @param text the plain text.
+         * @param spans the styled parts of `text`, in order and not overlapping.
+         */
+        StyledText(std::string text, std::vector<Span> spans) : _text(std::move(text)), _spans(std::move(spans)) {}
 
-        /* replace all occurences of `from` in `str` with `to` */
-        static std::string replaceAll(std::string str, const std::string& from, const std::string& to) {
-            size_t start_pos = 0;
-            while((start_pos = str.find(from, start_pos)) != std::string::npos) {
-                str.replace(start_pos, from.length(), to);
-                start_pos += to.length(); // Handles case where 'to' is a substring of 'from'
+        /** @return the text without any styling. */
+        const std::string& text() const { return _text; }
+
+        /** @return the styled parts of the text. */
+        const std::vector<Span>& spans() const { return _spans; }
+
+        /**
+         * Write part of a styled text with escape codes.
+         * @param text the plain text.
+         * @param spans the styled parts of `text`.
+         * @param begin, end the part of `text` to write.
+         * @param base the color of the text, the colors of styled spans are added to it.
+         * @param code, emphasis the colors of each style.
+         */
+        static void write(std::ostream& out, const std::string& text, const std::vector<Span>& spans, size_t begin, size_t end,
+                          const colors::Color& base, const colors::Color& code, const colors::Color& emphasis) {
+            for (auto& span : spans) {
+                if (span.end <= begin || span.start >= end)
+                    continue;
+                size_t start = std::max<size_t>(span.start, begin), stop = std::min<size_t>(span.end, end);
+                if (start > begin)
+                    base.print(out, text.substr(begin, start - begin));
+                (base & (span.style == Style::CODE ? code : emphasis)).print(out, text.substr(start, stop - start));
+                begin = stop;
             }
-            return str;
+            if (end > begin)
+                base.print(out, text.substr(begin, end - begin));
         }
 
-        /* returns whether the two diagnostics are on the same line */
-        static bool onSameLine(Diagnostic& a, Diagnostic& b) {
-            return a.loc.file == b.loc.file && a.loc.line == b.loc.line;
+        /**
+         * Write the text with escape codes.
+         * @param base the color of the text, the colors of styled spans are added to it.
+         * @param code, emphasis the colors of each style.
+         */
+        void write(std::ostream& out, const colors::Color& base, const colors::Color& code, const colors::Color& emphasis) const {
+            write(out, _text, _spans, 0, _text.size(), base, code, emphasis);
         }
 
-        /* split a string into its lines */
-        static std::vector<std::string> splitLines(const std::string& str) {
-            std::vector<std::string> strings;
-            std::string::size_type loc = 0;
-            std::string::size_type prev = 0;
-            while ((loc = str.find("\n", prev)) != std::string::npos) {
-                strings.push_back(str.substr(prev, loc - prev));
-                prev = loc + 1;
+        /**
+         * Write the text as HTML, styled spans in `<code>` and `<em>` tags.
+         */
+        void writeHtml(std::ostream& out) const {
+            size_t span = 0;
+            for (size_t i = 0; i <= _text.size(); i++) {
+                if (span < _spans.size() && _spans[span].end == i)
+                    out << (_spans[span++].style == Style::CODE ? "</code>" : "</em>");
+                if (i == _text.size())
+                    break;
+                if (span < _spans.size() && _spans[span].start == i)
+                    out << (_spans[span].style == Style::CODE ? "<code>" : "<em>");
+                switch (_text[i]) {
+                    case '&': out << "&amp;";  break;
+                    case '<': out << "&lt;";   break;
+                    case '>': out << "&gt;";   break;
+                    case '"': out << "&quot;"; break;
+                    default:  out << _text[i];
+                }
             }
-            // To get the last substring (or only, if delimiter is not found)
-            strings.push_back(str.substr(prev));
-            return strings;
         }
+    };
 
-        static uint32_t tabWidth(const Config& config, size_t pos) {
-            if (config.tabWidth == 0) return 0;
-            return config.tabWidth - pos % config.tabWidth;
-        }
+    /**
+     * Stores backtraces, such as "in expansion of macro X, included from Y" chains, for many diagnostics at once.
+     * Backtraces are nodes in a tree which only point to their parent frame, and identical frames are only stored once,
+     * so diagnostics whose backtraces share a prefix share its storage - a diagnostic only holds the id of its innermost frame.
+     * All member functions are thread safe.
+     */
+    class Backtraces {
+    public:
+        /** Id of a frame, the innermost frame of a backtrace identifies the whole backtrace. */
+        typedef uint32_t Frame;
 
-        /* prints `count` characters of whitespace */
-        static void indent(const Config& config, std::ostream& out, std::string& line, uint32_t count, size_t start = 0) {
-            for (uint32_t i = 0; i < count; i++)
-                out << (line[start + i] == '\t' ? std::string(tabWidth(config, start + i), ' ') : " ");
-        }
+        /** The empty backtrace. */
+        static const Frame none = 0;
 
-        static void printLine(const Config& config, std::ostream& out, std::string& line) {
-            for (size_t i = 0; i < line.size(); i++) {
-                if (line[i] == '\t')
-                    out << std::string(tabWidth(config, i), ' ');
-                else out << line[i];
-            }
-            out << "\n";
+        /* a frame of a backtrace, as returned by `get()` */
+        struct Node {
+            Frame parent;
+            std::string label; // e.g. "in expansion of 'FOO'"
+            Location loc;
+        };
+
+    private:
+        mutable std::mutex mutex;
+        std::vector<Node> nodes = { Node { none, "", {} } };
+        std::unordered_map<std::string, Frame> ids;
+
+    public:
+        /**
+         * Get the backtrace of `parent` with another frame inside it, creating it if it doesn't exist yet.
+         * @param parent the enclosing backtrace, `Backtraces::none` for the outermost frame.
+         * @param label describes the frame, e.g. "in expansion of 'FOO'" or "included from".
+         * @param location source code location of the frame.
+         * @return the new innermost frame.
+         */
+        Frame push(Frame parent, const std::string& label, Location location = {}) {
+            std::string key(reinterpret_cast<const char*>(&parent), sizeof(parent));
+            key.append(reinterpret_cast<const char*>(&location.file), sizeof(location.file));
+            key.append(reinterpret_cast<const char*>(&location.line), sizeof(location.line));
+            key.append(reinterpret_cast<const char*>(&location.start), sizeof(location.start));
+            key.append(reinterpret_cast<const char*>(&location.end), sizeof(location.end));
+            key += label;
+
+            std::lock_guard<std::mutex> lock(mutex);
+            auto found = ids.find(key);
+            if (found != ids.end())
+                return found->second;
+            auto id = static_cast<Frame>(nodes.size());
+            nodes.push_back({ parent, label, location });
+            ids.emplace(std::move(key), id);
+            return id;
         }
 
-        /* get corresponding underline character based intensity level */
-        static std::string getUnderline(const Config& config, int8_t level, std::string& line, size_t idx) {
-            std::string ret = "";
-            switch (level) {
-                case -1: ret = toString(config.chars.lineVertical); break;
-                case 0:  ret = " "; break;
-                case 1:  ret = toString(config.chars.underline1); break;
-                case 2:  ret = toString(config.chars.underline2); break;
-                case 3:  ret = toString(config.chars.underline3); break;
-                case 4:  ret = toString(config.chars.underline4); break;
-                default: ret = toString(level%2 ? config.chars.underlineA : config.chars.underlineB); break;
-            }
-            if (line[idx] == '\t')
-                return repeat(ret, tabWidth(config, idx));
+        /**
+         * @return the frames of a backtrace, innermost first.
+         */
+        std::vector<Node> get(Frame frame) const {
+            std::vector<Node> ret;
+            std::lock_guard<std::mutex> lock(mutex);
+            for (; frame != none; frame = nodes[frame].parent)
+                ret.push_back(nodes[frame]);
             return ret;
         }
 
-        /* return errTy' string representation + the error code if one exists */
-        std::string tyToString(const Config& config) {
-            std::string str;
-            switch (errTy) {
-                case DiagnosticType::INTERNAL_ERROR: 
-                case DiagnosticType::UNKNOWN: str = config.chars.internalErrorName; break;
-                case DiagnosticType::ERROR:   str = config.chars.errorName;         break;
-                case DiagnosticType::WARNING: str = config.chars.warningName;       break;
-                case DiagnosticType::NOTE:    str = config.chars.noteName;          break;
-                case DiagnosticType::HELP:    str = config.chars.helpName;          break;
-            }
-            if (code != "")
-                return str + toString(config.chars.errCodeBracketLeft) + code  + toString(config.chars.errCodeBracketRight);
-            else return str;
+        /** @return number of distinct frames stored. */
+        size_t size() const {
+            std::lock_guard<std::mutex> lock(mutex);
+            return nodes.size() - 1;
         }
+    };
 
-        /* returns errTy's color */
-        const colors::Color& color(const Config& config) {
-            switch (errTy) {
-                case DiagnosticType::INTERNAL_ERROR: 
-                case DiagnosticType::UNKNOWN: 
-                case DiagnosticType::ERROR:   return config.colors.error;
-                case DiagnosticType::WARNING: return config.colors.warning;
-                case DiagnosticType::NOTE:    return config.colors.note;
-                case DiagnosticType::HELP:    return config.colors.help;
-            }
-            return colors::none;
-        }
+    /**
+     * A compiled catalog of localized messages, such as translated names for the diagnostic types.
+     * Catalogs are compiled ahead of time by `Catalog::compile()` into a hash table of message ids to UTF-8 strings,
+     * each stored along with its display width. Opening a catalog maps the file into memory (or reads it, where
+     * `mmap` is unavailable) and lookups read straight from the mapping, nothing is parsed or copied.
+     */
+    class Catalog {
+    public:
+        /* a message as stored in the catalog, note that `data` is not null terminated */
+        struct Message {
+            const char* data;
+            uint32_t size;
+            uint32_t width; // number of terminal columns the message takes up
+
+            explicit operator bool() const { return data != nullptr; }
+            std::string str() const { return data ? std::string(data, size) : std::string(); }
+        };
 
-        /* returns errTy's color if `c` is `colors::inherit` (otherwise returns c)*/
-        const colors::Color& maybeInherit(const Config& config, const colors::Color& c) {
-            if (c == colors::inherit)
-                return color(config);
-            else return c;
+    private:
+        /* the file starts with a header, followed by `buckets` entries, followed by the text of all ids and messages */
+        struct Header {
+            char magic[4];
+            uint32_t version;
+            uint32_t buckets; // always a power of two
+            uint32_t count;
+        };
+
+        struct Entry {
+            uint64_t hash; // 0 marks an empty bucket
+            uint32_t idOffset, idSize;
+            uint32_t offset, size;
+            uint32_t width;
+            uint32_t reserved;
+        };
+
+        const char* data = nullptr;
+        size_t length = 0;
+        bool mapped = false;
+        std::vector<char> buffer; // holds the file when it isn't mapped
+
+        static uint64_t hash(const char* str, size_t size) {
+            uint64_t h = 14695981039346656037ULL; // FNV-1a
+            for (size_t i = 0; i < size; i++)
+                h = (h ^ static_cast<unsigned char>(str[i])) * 1099511628211ULL;
+            return h ? h : 1;
         }
 
-        /* sort the vector of secondary messages based on the order we want to be printing them */
-        void sortSecondaries() {
-            auto file = loc.file;
-            std::sort(
-                std::begin(secondaries), std::end(secondaries), 
-                [file](Diagnostic &a, Diagnostic &b) {
-                    if (!a.loc.file) 
-                        return false;
-                    if (!b.loc.file) 
-                        return true;
-                    if (a.loc.file == file && b.loc.file != file)
-                        return true;
-                    if (a.loc.file != file && b.loc.file == file)
-                        return false;
-                    if (a.loc.file != b.loc.file)
-                        return a.loc.file->str() < b.loc.file->str();
-                    if (a.loc.line == b.loc.line)
-                        return a.loc.start > b.loc.start; 
-                    return a.loc.line < b.loc.line;
+        /* columns taken up by a UTF-8 string, counting east asian wide characters twice */
+        static uint32_t displayWidth(const std::string& str) {
+            uint32_t width = 0;
+            for (size_t i = 0; i < str.size();) {
+                auto c = static_cast<unsigned char>(str[i]);
+                uint32_t cp = c, len = c < 0x80 ? 1 : c < 0xE0 ? 2 : c < 0xF0 ? 3 : 4;
+                if (len > 1) {
+                    cp = c & (0x3F >> (len - 1));
+                    for (uint32_t j = 1; j < len && i + j < str.size(); j++)
+                        cp = (cp << 6) | (static_cast<unsigned char>(str[i + j]) & 0x3F);
                 }
-            );
+                bool wide = (cp >= 0x1100 && cp <= 0x115F) || (cp >= 0x2E80 && cp <= 0xA4CF) || (cp >= 0xAC00 && cp <= 0xD7A3)
+                         || (cp >= 0xF900 && cp <= 0xFAFF) || (cp >= 0xFE30 && cp <= 0xFE4F) || (cp >= 0xFF00 && cp <= 0xFF60)
+                         || (cp >= 0xFFE0 && cp <= 0xFFE6) || (cp >= 0x20000 && cp <= 0x3FFFD);
+                width += wide ? 2 : 1;
+                i += len;
+            }
+            return width;
         }
-        
-        /* prints the bars on the left with the correct indentation */
-        void printLeft(const Config& config, std::ostream& out, uint32_t maxLine, bool printBar = true) {
-            out << std::string(std::to_string(maxLine).size() + config.padding.beforeLineNum + config.padding.afterLineNum, ' ');
-            if (printBar)
-                maybeInherit(config, config.colors.border).print(out, toString(config.chars.borderVertical) + std::string(config.padding.borderLeft, ' '));
+
+        const Header* header() const { return reinterpret_cast<const Header*>(data); }
+        const Entry* entries() const { return reinterpret_cast<const Entry*>(data + sizeof(Header)); }
+
+        /* checks the header and table fit in the file, so that `lookup()` only needs to check the text */
+        bool validate() const {
+            if (length < sizeof(Header) || std::memcmp(header()->magic, "RPCT", 4) != 0 || header()->version != 1)
+                return false;
+            uint64_t buckets = header()->buckets;
+            return buckets && !(buckets & (buckets - 1)) && sizeof(Header) + buckets * sizeof(Entry) <= length;
         }
 
-        /* prints the `╭─ file.xyz ─╴` at the start of the file's diagnostics */
-        void printTop(const Config& config, std::ostream& out, SourceFile* file, uint32_t maxLine) {
-            printLeft(config, out, maxLine, false);
-            maybeInherit(config, config.colors.border).print(out, config.chars.beforeFileName); 
-            out << file->str();
-            maybeInherit(config, config.colors.border).print(out, config.chars.afterFileName);
-            out << "\n";
+    public:
+        Catalog() = default;
+        Catalog(const Catalog&) = delete;
+        Catalog& operator=(const Catalog&) = delete;
+        ~Catalog() { close(); }
+
+        /**
+         * Open a catalog file written by `compile()`.
+         */
+        explicit Catalog(const std::string& path) { open(path); }
+
+        /**
+         * Compile messages into a catalog file. The file uses the machine's byte order.
+         * @param path the file to write.
+         * @param messages pairs of message id and UTF-8 text, if an id appears twice the last one is kept.
+         * @return whether the file was written successfully.
+         */
+        static bool compile(const std::string& path, const std::vector<std::pair<std::string, std::string>>& messages) {
+            uint32_t buckets = 1;
+            while (buckets < messages.size() * 2)
+                buckets *= 2;
+            std::vector<Entry> table(buckets, Entry { 0, 0, 0, 0, 0, 0, 0 });
+            std::string text;
+            uint32_t count = 0;
+            for (auto& msg : messages) {
+                uint64_t h = hash(msg.first.data(), msg.first.size());
+                size_t i = h & (buckets - 1);
+                while (table[i].hash && !(table[i].hash == h && text.compare(table[i].idOffset, table[i].idSize, msg.first) == 0))
+                    i = (i + 1) & (buckets - 1);
+                if (!table[i].hash) {
+                    table[i].hash = h;
+                    table[i].idOffset = static_cast<uint32_t>(text.size());
+                    table[i].idSize = static_cast<uint32_t>(msg.first.size());
+                    text += msg.first;
+                    count++;
+                }
+                table[i].offset = static_cast<uint32_t>(text.size());
+                table[i].size = static_cast<uint32_t>(msg.second.size());
+                table[i].width = displayWidth(msg.second);
+                text += msg.second;
+            }
+            // offsets are stored relative to the start of the file
+            uint32_t base = static_cast<uint32_t>(sizeof(Header) + buckets * sizeof(Entry));
+            for (auto& entry : table) {
+                if (entry.hash) {
+                    entry.idOffset += base;
+                    entry.offset += base;
+                }
+            }
+            Header head = { { 'R', 'P', 'C', 'T' }, 1, buckets, count };
+            std::ofstream file(path, std::ios::binary);
+            file.write(reinterpret_cast<const char*>(&head), sizeof(head));
+            file.write(reinterpret_cast<const char*>(table.data()), static_cast<std::streamsize>(table.size() * sizeof(Entry)));
+            file.write(text.data(), static_cast<std::streamsize>(text.size()));
+            return static_cast<bool>(file);
         }
 
-        /* prints the border at the end of the file's diagnostics */
-        void printBottom(const Config& config, std::ostream& out, uint32_t maxLine) {
-            for (uint8_t i = 0; i < config.padding.borderBottom; i++) {
-                printLeft(config, out, maxLine);
-                out << "\n";
+        /**
+         * Replace the catalog with one read from a file written by `compile()`.
+         * @return whether the file was opened successfully, if not the catalog is left empty.
+         */
+        bool open(const std::string& path) {
+            close();
+#ifdef REPORTER_POSIX
+            int fd = ::open(path.c_str(), O_RDONLY);
+            if (fd < 0)
+                return false;
+            struct stat st;
+            if (fstat(fd, &st) == 0 && st.st_size > 0) {
+                void* addr = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+                if (addr != MAP_FAILED) {
+                    data = static_cast<const char*>(addr);
+                    length = static_cast<size_t>(st.st_size);
+                    mapped = true;
+                }
             }
-            for (size_t i = 0; i < std::to_string(maxLine).size() + config.padding.beforeLineNum + config.padding.afterLineNum; i++)
-                maybeInherit(config, config.colors.border).print(out, toString(config.chars.borderHorizontal));
-            maybeInherit(config, config.colors.border).print(out, toString(config.chars.borderBottomRight));
-            out << "\n";
+            ::close(fd);
+#endif
+            if (!mapped) {
+                std::ifstream file(path, std::ios::binary);
+                buffer.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+                data = buffer.data();
+                length = buffer.size();
+            }
+            if (!validate()) {
+                close();
+                return false;
+            }
+            return true;
         }
 
-        /* prints the bars on the left with the correct indentation + with the line number */
-        void printLeftWithLineNum(const Config& config, std::ostream& out, uint32_t lineNum, uint32_t maxLine, bool printBar = true) {
-            auto targetSize = std::to_string(maxLine).size() + config.padding.beforeLineNum + config.padding.afterLineNum;
-            auto str = std::string(config.padding.beforeLineNum, ' ') + std::to_string(lineNum) + std::string(config.padding.afterLineNum, ' ');
-            while (str.size() < targetSize)
-                str += " ";
-            if (lineNum == loc.line)
-                maybeInherit(config, config.colors.highlightLineNum).print(out, str);
-            else maybeInherit(config, config.colors.lineNum).print(out, str);
-            if (printBar)
-                    maybeInherit(config, config.colors.border).print(out, toString(config.chars.borderVertical) + std::string(config.padding.borderLeft, ' '));
+        /**
+         * Unmap the catalog, leaving it empty. Messages looked up earlier may no longer be used.
+         */
+        void close() {
+#ifdef REPORTER_POSIX
+            if (mapped)
+                munmap(const_cast<char*>(data), length);
+#endif
+            data = nullptr;
+            length = 0;
+            mapped = false;
+            std::vector<char>().swap(buffer);
         }
 
-        /* a 'padding' line is an irrelevant line in between two other relevant lines */
-        void printPadding(const Config& config, std::ostream& out, uint32_t maxLine, uint32_t lastLine, uint32_t currLine, SourceFile *file) {
-            if (lastLine + 2 == currLine) {
-                printLeftWithLineNum(config, out, currLine - 1, maxLine);
-                out << file->getLine(currLine - 1) << "\n";
-            } else {
-                out << " ";
-                switch (std::to_string(maxLine).size() + config.padding.beforeLineNum + config.padding.afterLineNum) {
-                    case 3:  color(config).print(out, "⋯"); break;
-                    case 4:  color(config).print(out, "··"); break;
-                    default: color(config).print(out, "···"); break;
-                }
-                out << "\n";
+        /** @return whether a catalog is open. */
+        bool isOpen() const { return data != nullptr; }
+
+        /** @return number of messages in the catalog. */
+        size_t size() const { return data ? header()->count : 0; }
+
+        /**
+         * Find a message by its id. The message points into the catalog and is valid until it is closed.
+         * @return the message, or an empty message (which converts to false) if the id isn't in the catalog.
+         */
+        Message lookup(const char* id, size_t size) const {
+            if (!data)
+                return Message { nullptr, 0, 0 };
+            uint64_t h = hash(id, size);
+            uint32_t mask = header()->buckets - 1;
+            for (uint32_t i = h & mask, probes = 0; probes <= mask; i = (i + 1) & mask, probes++) {
+                const Entry& entry = entries()[i];
+                if (!entry.hash)
+                    break;
+                if (entry.hash != h || entry.idSize != size)
+                    continue;
+                if (uint64_t(entry.idOffset) + entry.idSize > length || uint64_t(entry.offset) + entry.size > length)
+                    break; // corrupt file
+                if (std::memcmp(data + entry.idOffset, id, size) == 0)
+                    return Message { data + entry.offset, entry.size, entry.width };
             }
+            return Message { nullptr, 0, 0 };
         }
 
-        /* prints all secondary messages on the current line */
-        void printSecondariesOnLine(const Config& config, std::ostream& out, std::string &line, size_t &i, uint32_t maxLine, bool shownAbove) {
-            auto &first = secondaries[i];
-            if (!shownAbove && first.loc == loc) { i++; return; }
-            printLeft(config, out, maxLine);
-            
-            if (i + 1 >= secondaries.size() || !onSameLine(first, secondaries[i + 1])) {
-                // only one secondary concerning this line
-                indent(config, out, line, first.loc.start);
-                for (auto idx = first.loc.start; idx < first.loc.end; idx++)
-                    first.color(config).print(out, getUnderline(config, 1, line, idx));
-
-                auto lines = splitLines(first.msg);
-                
-                for (size_t idx = 0; idx < lines.size(); idx++) {
-                    if (idx != 0) {
-                        printLeft(config, out, maxLine);
-                        indent(config, out, line, first.loc.end);
-                    }
-                    out << " ";
-                    first.color(config).print(out, lines[idx]);
-                    out << "\n";
-                }
+        /** @see lookup(const char*, size_t) */
+        Message lookup(const std::string& id) const { return lookup(id.data(), id.size()); }
+    };
 
-                for (auto& sec : first.secondaries) {
-                    lines = splitLines(sec.msg);
-                    for (size_t idx = 0; idx < lines.size(); idx++) {
-                        if (first.msg != "" || idx != 0) {
-                            printLeft(config, out, maxLine);
-                            indent(config, out, line, sec.loc.end);
-                        }
-                        out << " ";
-                        sec.color(config).print(out, lines[idx]);
-                        out << "\n";
-                    }
-                }
-                i++;
-            } else {
-                std::vector<std::vector<Diagnostic*>> toRender;
-                uint8_t depth = 0;
-                size_t index = i;
-                while (index < secondaries.size() && onSameLine(secondaries[index], first))
-                    index++;
+    /**
+     * RICH:
+     *     Error(E308): a rich error
+     *        ╭─ test.cpp ─╴
+     *        │ 
+     *      4 │     int n = 10;
+     *        │     ^^^ a submessage
+     *     ───╯
+     * 
+     * SHORT:
+     *     test.cpp:4:4:7: Error(E308): a rich error
+     */
+    enum class DisplayStyle { RICH, SHORT };
 
-                for (size_t idx = index; idx > i; idx--) {
-                    if (toRender.size() == 0)
-                        toRender.push_back({ &secondaries[idx-1] });
-                    else {
-                        bool foundClash = false;
+    /**
+     * You can customize most aspects of the display settings such as color, padding, used characters, etc.
+     * Simply create a Config object, change the values to your liking, and pass them to the print() function.
+     */
+    class Config {
+    public:
+
+        /* Contrls whether the diagnostics are displayed in RICH or SHORT mode, default is RICH */
+        DisplayStyle style;
+
+        /* Number of spaces to render per tab */
+        uint32_t tabWidth;
+
+        /* Syntax highlighter for lines of source code, nullptr disables highlighting */
+        Highlighter* highlighter = nullptr;
+
+        /* Maps locations in generated code to their origin, nullptr prints locations as they are */
+        const SourceMap* sourceMap = nullptr;
+
+        /*
+         * Number of threads reading the source files of a diagnostic which spans several files that weren't read yet, 1 reads them in turn.
+         * More than 1 calls `SourceFile::str()` and `SourceFile::read()` of different files concurrently, so they must be thread safe.
+         */
+        uint32_t readThreads = 1;
+
+        /* The colors to be displayed for each type of diagnostic, as well as some general color settings */
+        struct {
+            colors::Color error = colors::fgred & colors::bold;
+            colors::Color warning = colors::fgyellow & colors::bold;
+            colors::Color note = colors::fgblack & colors::bold;
+            colors::Color help = colors::fgblue & colors::bold;
+            colors::Color message = colors::bold; // the color of the main error message
+            colors::Color border = colors::inherit;
+            colors::Color lineNum = colors::inherit;
+            colors::Color highlightLineNum = colors::inherit;
+            colors::Color code = colors::fgcyan; // added to the message's color in `code` spans of a `StyledText`
+            colors::Color emphasis = colors::underline; // added to the message's color in *emphasis* spans of a `StyledText`
+        } colors;
+
+        /* padding is empty space which is added to make the diagnostics more readable */
+        struct {
+            /*
+                    ╭─ file.xyz ─
+                    │ ┐
+                    │ ├─ borderTop
+                    │ ┘
+               17   │   int n = 20
+            └┬┘  └┬┘│└┬┘
+             │    │ │ ╰ borderLeft
+             │    ╰ afterLineNum
+             ╰ beforeLineNum
+                    │ ┐
+                    │ ├─ borderBottom
+                    │ ┘
+                 ───╯
+            */
+            uint8_t beforeLineNum = 1;
+            uint8_t afterLineNum = 1;
+            uint8_t borderTop = 1;
+            uint8_t borderLeft = 1;
+            uint8_t borderBottom = 0;
+        } padding;
+
+        /** 
+         * Controls all the characters which are to be rendered. 
+         * Note: some of these are stored as strings, while others are stored as single characters.
+         */
+        struct {
+            std::string errorName = "Error";
+            std::string warningName = "Warning";
+            std::string noteName = "Note";
+            std::string helpName = "Help";
+            std::string internalErrorName = "Internal Error";
+            std::string fixName = "Fix";
+
+            std::string shortModeLineSeperator = " / "; // seperates multi-line diagnostic messages
+
+            wchar_t errCodeBracketLeft  = L'(';
+            wchar_t errCodeBracketRight = L')';
+
+            std::string beforeFileName  = "╭─ ";
+            std::string afterFileName   = " ─╴";
+
+            wchar_t borderVertical      = L'│';
+            wchar_t borderHorizontal    = L'─';
+            wchar_t borderBottomRight   = L'╯';
+            wchar_t noteBullet          = L'•';
+
+            wchar_t lineVertical        = L'│';
+            std::string lineBottomLeft  = "╰ ";
+
+            wchar_t arrowDown           = L'v';
+            wchar_t arrowUp             = L'^';
+            wchar_t underline1          = L'~';
+            wchar_t underline2          = L'=';
+            wchar_t underline3          = L'#';
+            wchar_t underline4          = L'*';
+            wchar_t underlineA          = L'-';
+            wchar_t underlineB          = L'+';
+        } chars;
+
+        /* Limits on how much is rendered, 0 means unlimited */
+        struct {
+            /* number of diagnostics sharing a kind, code and message which are printed in full before the rest are collapsed into a summary */
+            uint32_t similar = 5;
+            /* number of line numbers listed per file in a collapsed summary */
+            uint32_t summaryLines = 10;
+            /* number of errors printed, like `-fmax-errors=N`: only the N earliest errors by file, line and column are kept, and are printed on flush - the budget is shared by every flush of a reporter */
+            uint32_t errors = 0;
+            /* number of backtrace frames printed per diagnostic */
+            uint32_t backtrace = 10;
+            /* number of secondary messages printed per file of a diagnostic */
+            uint32_t secondariesPerFile = 0;
+            /* number of files printed per diagnostic */
+            uint32_t files = 0;
+            /* number of source lines (and notes without a location) printed per diagnostic */
+            uint32_t lines = 0;
+        } limits;
+
+        /* display widths of the names set by `localize()`, by name, so that text after a wide name lines up with it */
+        std::unordered_map<std::string, uint32_t> nameWidths;
+
+        Config() : style(DisplayStyle::RICH), tabWidth(4) { }
+
+        /**
+         * Take the names of the diagnostic types from a message catalog. The ids looked up are
+         * "reporter.error", "reporter.warning", "reporter.note", "reporter.help", "reporter.internal_error" and "reporter.fix",
+         * names which are missing from the catalog are left as they are. The display width the catalog stores
+         * for each name is used to align the lines which follow it.
+         */
+        void localize(const Catalog& catalog) {
+            const std::pair<const char*, std::string*> names[] = {
+                { "reporter.error", &chars.errorName },
+                { "reporter.warning", &chars.warningName },
+                { "reporter.note", &chars.noteName },
+                { "reporter.help", &chars.helpName },
+                { "reporter.internal_error", &chars.internalErrorName },
+                { "reporter.fix", &chars.fixName },
+            };
+            for (auto& name : names)
+                if (auto msg = catalog.lookup(name.first, std::strlen(name.first))) {
+                    *name.second = msg.str();
+                    nameWidths[*name.second] = msg.width;
+                }
+        }
+    };
+
+    /////////////////////////////////////////////////////////////////////////
+
+    /**
+     * The builtin diagnostic kinds, whose names and colors are taken from the config.
+     * A user-defined kind is a type with the same three members, for example:
+     * 
+     *     struct Lint {
+     *         static constexpr reporter::DiagnosticType severity = reporter::DiagnosticType::WARNING;
+     *         static std::string name(const reporter::Config&) { return "Lint"; }
+     *         static reporter::colors::Color color(const reporter::Config&) { return reporter::colors::fgcyan; }
+     *     };
+     * 
+     *     reporter::DiagnosticTy<Lint>("redundant cast", loc).print(std::cerr);
+     * 
+     * The severity decides how the diagnostic is counted, prioritized and suppressed, as if it were a builtin diagnostic of that type.
+     */
+    template<DiagnosticType T>
+    struct BuiltinKind {
+        static constexpr DiagnosticType severity = T;
+
+        static std::string name(const Config& config) {
+            switch (T) {
+                case DiagnosticType::INTERNAL_ERROR: 
+                case DiagnosticType::UNKNOWN: return config.chars.internalErrorName;
+                case DiagnosticType::ERROR:   return config.chars.errorName;
+                case DiagnosticType::WARNING: return config.chars.warningName;
+                case DiagnosticType::NOTE:    return config.chars.noteName;
+                case DiagnosticType::HELP:    return config.chars.helpName;
+            }
+            return "";
+        }
+
+        static colors::Color color(const Config& config) {
+            switch (T) {
+                case DiagnosticType::INTERNAL_ERROR: 
+                case DiagnosticType::UNKNOWN: 
+                case DiagnosticType::ERROR:   return config.colors.error;
+                case DiagnosticType::WARNING: return config.colors.warning;
+                case DiagnosticType::NOTE:    return config.colors.note;
+                case DiagnosticType::HELP:    return config.colors.help;
+            }
+            return colors::none;
+        }
+    };
+
+    template<DiagnosticType T> constexpr DiagnosticType BuiltinKind<T>::severity;
+
+    /**
+     * The dispatch table of a diagnostic kind, one per kind type.
+     */
+    struct DiagnosticKind {
+        DiagnosticType severity;
+        std::string (*name)(const Config&);
+        colors::Color (*color)(const Config&);
+        std::string key; // the kind's name in the default config, which identifies the kind the same way in every run
+
+        /** @return the table of `Kind`. */
+        template<typename Kind>
+        static const DiagnosticKind* of() {
+            static const DiagnosticKind table = { Kind::severity, &Kind::name, &Kind::color, Kind::name(Config()) };
+            return &table;
+        }
+
+        /** @return the table of the builtin kind of type `ty`. */
+        static const DiagnosticKind* of(DiagnosticType ty) {
+            switch (ty) {
+                case DiagnosticType::INTERNAL_ERROR: return of<BuiltinKind<DiagnosticType::INTERNAL_ERROR>>();
+                case DiagnosticType::ERROR:          return of<BuiltinKind<DiagnosticType::ERROR>>();
+                case DiagnosticType::WARNING:        return of<BuiltinKind<DiagnosticType::WARNING>>();
+                case DiagnosticType::NOTE:           return of<BuiltinKind<DiagnosticType::NOTE>>();
+                case DiagnosticType::HELP:           return of<BuiltinKind<DiagnosticType::HELP>>();
+                case DiagnosticType::UNKNOWN:        break;
+            }
+            return of<BuiltinKind<DiagnosticType::UNKNOWN>>();
+        }
+    };
+
+    /**
+     * These are all the parts which are rendered by `print`:
+     *
+     *      header╶─╴│ Error(E308): a complex error
+     *         top╶─╴│   ╭─ example.cpp ─╴
+     *               │   │ 
+     *     snippet╶─╴│ 1 │ #include "reporter.hpp"
+     *   secondary╶─╴│   │ ~~~~~~~~ a relevant include
+     *     padding╶─╴│ 2 │ 
+     *     snippet╶─╴│ 3 │ int main() {
+     *   secondary╶─╴│   │            ~ curly brace
+     *     padding╶─╴│ ⋯
+     *  subMessage╶─╴│   │          this is where the error is, hence the bold red
+     *               │   │          vvvv
+     *     snippet╶─╴│ 7 │     auto file = new reporter::SimpleFile("example.cpp");
+     *             ┌╴│   │     ~~~~ ~~~~ ~               ~~~~~~~~~~                
+     *             │ │   │     │    │    │               ╰ a help message
+     * secondaries╶┤ │   │     │    │    ╰ assignment
+     *             │ │   │     │    ╰ a variable
+     *             └╴│   │     ╰ a type
+     *      bottom╶─╴│───╯
+     *   secondary╶─╴│     • Help: a general help message,
+     *               │             not set to any specific location
+     */
+    class Diagnostic {
+        friend class Reporter;
+        friend class EmergencyEmitter;
+        friend class DiagnosticPool;
+        template<typename Kind> friend class DiagnosticTy;
+    private:
+        std::string msg;
+        std::string subMsg;
+        std::vector<StyledText::Span> msgStyle;    // styled spans of `msg`, see `StyledText`
+        std::vector<StyledText::Span> subMsgStyle; // styled spans of `subMsg`
+        Location loc;
+        DiagnosticType errTy;
+        const DiagnosticKind* kindTable; // resolves the name and color of the diagnostic
+        std::string code;
+        /* 
+         * A secondary message. Secondaries are stored in one flat array: a secondary at the location of an earlier one 
+         * is attached to it as a child (and rendered along with it) by the index of its parent.
+         */
+        struct Secondary {
+            std::shared_ptr<const Diagnostic> diag; // immutable, may be shared with other diagnostics (see `withShared`)
+            uint32_t parent;         // index of the secondary this one is attached to, or `noParent`
+            uint32_t firstChild = 0; // once sorted, the children of a secondary are the `childCount` secondaries from `firstChild`
+            uint32_t childCount = 0;
+            uint64_t position;       // sort key within a file - by line, then by start in descending order
+
+            Secondary(std::shared_ptr<const Diagnostic> d, uint32_t parentIndex) 
+                : diag(std::move(d)), parent(parentIndex), position(diag ? positionOf(diag->loc) : 0) {}
+
+            static uint64_t positionOf(const Location& loc) {
+                return static_cast<uint64_t>(loc.line) << 32 | (0xFFFFFFFF - loc.start);
+            }
+
+            const Diagnostic* get() const { return diag.get(); }
+            const Diagnostic* operator->() const { return diag.get(); }
+            const Diagnostic& operator*() const { return *diag; }
+        };
+        static constexpr uint32_t noParent = 0xFFFFFFFF;
+
+        std::vector<Secondary> secondaries; // once sorted, the top level secondaries in order, followed by the children of each of them in turn
+        uint32_t topCount = 0;              // number of top level secondaries, set by `sortSecondaries`
+        std::vector<FixIt> fixits;
+        const MessageTemplate* tmpl = nullptr; // if set, the message is `tmpl` formatted with `args` rather than `msg`
+        std::vector<std::string> args;
+        const Backtraces* traces = nullptr;
+        Backtraces::Frame frame = Backtraces::none;
+
+        /* count number of utf8 characters in a string, if invalid character is found returns std::string::npos. */
+        static size_t countChars(std::string str) {
+            #define MSB (1 << 7)
+            size_t sum = 0;
+            for (size_t i = 0; i < str.size(); i++) {
+                char c = str[i];
+                if (c & MSB) {
+                    c <<= 1;
+                    if ((c & MSB) == 0)
+                        return std::string::npos;
+                    do {
+                        i++;
+                        c <<= 1;
+                    } while (c & MSB);
+                }
+                sum++;
+            }
+            return sum;
+            #undef MSB
+        }
+
+        /* unicode code point to string */
+        static std::string toString(char32_t cp)
+        {
+            uint8_t c[5] = { 0 };
+            if      (cp<=0x7F) { c[0] = static_cast<uint8_t>(cp); } 
+            else if (cp<=0x7FF) { c[0] = static_cast<uint8_t>((cp>>6)+192); c[1] = static_cast<uint8_t>((cp&63)+128); }
+            else if (0xd800<=cp && cp<=0xdfff) { /*invalid block of utf8*/ } 
+            else if (cp <= 0xFFFF)   { 
+                c[0] = static_cast<uint8_t>((cp>>12)+224);
+                c[1] = static_cast<uint8_t>(((cp>>6)&63)+128);
+                c[2] = static_cast<uint8_t>((cp&63)+128); 
+            } 
+            else if (cp <= 0x10FFFF) { 
+                c[0] = static_cast<uint8_t>((cp>>18)+240);
+                c[1] = static_cast<uint8_t>(((cp>>12)&63)+128); 
+                c[2] = static_cast<uint8_t>(((cp>>6)&63)+128);
+                c[3] = static_cast<uint8_t>((cp&63)+128); }
+            return std::string(reinterpret_cast<char*>(c));
+        }
+
+        /* repeat `s` `n` times */
+        static std::string repeat(std::string s, size_t n) 
+        { 
+            std::string s1 = s; 
+            for (size_t i=1; i<n;i++)  s += s1;
+            return s; 
+        }
+
+        /* replace all occurences of `from` in `str` with `to` */
+        static std::string replaceAll(std::string str, const std::string& from, const std::string& to) {
+            size_t start_pos = 0;
+            while((start_pos = str.find(from, start_pos)) != std::string::npos) {
+                str.replace(start_pos, from.length(), to);
+                start_pos += to.length(); // Handles case where 'to' is a substring of 'from'
+            }
+            return str;
+        }
+
+        /* returns whether the two diagnostics are on the same line */
+        static bool onSameLine(const Diagnostic& a, const Diagnostic& b) {
+            return a.loc.file == b.loc.file && a.loc.line == b.loc.line;
+        }
+
+        /* split a string into its lines */
+        static std::vector<std::string> splitLines(const std::string& str) {
+            std::vector<std::string> strings;
+            std::string::size_type loc = 0;
+            std::string::size_type prev = 0;
+            while ((loc = str.find("\n", prev)) != std::string::npos) {
+                strings.push_back(str.substr(prev, loc - prev));
+                prev = loc + 1;
+            }
+            // To get the last substring (or only, if delimiter is not found)
+            strings.push_back(str.substr(prev));
+            return strings;
+        }
+
+        /* prints line `idx` of `text` (which is `line`) lowering the styled spans to escape codes, `prefix` is printed before it */
+        static void printStyled(std::ostream& out, const Config& config, const colors::Color& color, const std::string& text,
+                                const std::vector<StyledText::Span>& spans, size_t idx, const std::string& line, const std::string& prefix = "") {
+            if (spans.empty()) {
+                color.print(out, prefix + line);
+                return;
+            }
+            if (prefix != "")
+                color.print(out, prefix);
+            size_t begin = 0;
+            for (size_t k = 0; k < idx; k++)
+                begin = text.find('\n', begin) + 1;
+            StyledText::write(out, text, spans, begin, begin + line.size(), color, config.colors.code, config.colors.emphasis);
+        }
+
+        static uint32_t tabWidth(const Config& config, size_t pos) {
+            if (config.tabWidth == 0) return 0;
+            return config.tabWidth - pos % config.tabWidth;
+        }
+
+        /* prints `count` characters of whitespace */
+        static void indent(const Config& config, std::ostream& out, std::string& line, uint32_t count, size_t start = 0) {
+            for (uint32_t i = 0; i < count; i++)
+                out << (line[start + i] == '\t' ? std::string(tabWidth(config, start + i), ' ') : " ");
+        }
+
+        static void printLine(const Config& config, std::ostream& out, std::string& line) {
+            for (size_t i = 0; i < line.size(); i++) {
+                if (line[i] == '\t')
+                    out << std::string(tabWidth(config, i), ' ');
+                else out << line[i];
+            }
+            out << "\n";
+        }
+
+        /* prints a line of source code, syntax highlighted if the config has a highlighter */
+        static void printLine(const Config& config, std::ostream& out, std::string& line, SourceFile* file, uint32_t lineNum) {
+            if (!config.highlighter) {
+                printLine(config, out, line);
+                return;
+            }
+            // spans must match the printed text, which comes from `getLine()` - only use the index's cache if it has the same text
+            auto index = file->index();
+            size_t size = 0;
+            auto data = index->line(lineNum, size);
+            auto spans = data && line.compare(0, std::string::npos, data, size) == 0
+                       ? index->highlight(*config.highlighter, lineNum) : config.highlighter->highlight(line);
+            size_t span = 0;
+            const colors::Color* current = &colors::none;
+            for (size_t i = 0; i < line.size(); i++) {
+                while (span < spans.size() && spans[span].end <= i)
+                    span++;
+                auto next = span < spans.size() && spans[span].start <= i ? &spans[span].color : &colors::none;
+                // only switch colors when they differ, so adjacent spans of the same color don't emit extra escapes
+                if (!(*next == *current)) {
+                    if (!(*current == colors::none))
+                        out << rang::style::reset;
+                    next->begin(out);
+                    current = next;
+                }
+                if (line[i] == '\t')
+                    out << std::string(tabWidth(config, i), ' ');
+                else out << line[i];
+            }
+            if (!(*current == colors::none))
+                out << rang::style::reset;
+            out << "\n";
+        }
+
+        /* get corresponding underline character based intensity level */
+        static std::string getUnderline(const Config& config, int8_t level, std::string& line, size_t idx) {
+            std::string ret = "";
+            switch (level) {
+                case -1: ret = toString(config.chars.lineVertical); break;
+                case 0:  ret = " "; break;
+                case 1:  ret = toString(config.chars.underline1); break;
+                case 2:  ret = toString(config.chars.underline2); break;
+                case 3:  ret = toString(config.chars.underline3); break;
+                case 4:  ret = toString(config.chars.underline4); break;
+                default: ret = toString(level%2 ? config.chars.underlineA : config.chars.underlineB); break;
+            }
+            if (line[idx] == '\t')
+                return repeat(ret, tabWidth(config, idx));
+            return ret;
+        }
+
+        /* return the kind's name + the error code if one exists */
+        std::string tyToString(const Config& config) const {
+            return tyToString(config, *kindTable, code);
+        }
+
+        /* the number of columns `tyToString(config)` takes up */
+        size_t tyWidth(const Config& config) const {
+            auto name = kindTable->name(config);
+            auto known = config.nameWidths.find(name);
+            auto width = known != config.nameWidths.end() ? known->second : countChars(name);
+            return code != "" ? width + countChars(code) + 2 : width;
+        }
+
+        static std::string tyToString(const Config& config, const DiagnosticKind& kind, const std::string& code) {
+            auto str = kind.name(config);
+            if (code != "")
+                return str + toString(config.chars.errCodeBracketLeft) + code  + toString(config.chars.errCodeBracketRight);
+            else return str;
+        }
+
+        /* returns the kind's color */
+        colors::Color color(const Config& config) const {
+            return kindTable->color(config);
+        }
+
+        /* returns the kind's color if `c` is `colors::inherit` (otherwise returns c)*/
+        colors::Color maybeInherit(const Config& config, const colors::Color& c) {
+            if (c == colors::inherit)
+                return color(config);
+            else return c;
+        }
+
+        /* 
+         * sort the secondary messages based on the order we want to be printing them - by file (this diagnostic's file first),
+         * then by line, then by start in descending order - and group the children of each top level secondary after them
+         */
+        void sortSecondaries() {
+            // rank the other files by path once, so that sorting only compares integers
+            std::vector<std::pair<std::string, SourceFile*>> files;
+            for (auto& secondary : secondaries) {
+                auto file = secondary->loc.file;
+                if (secondary.parent != noParent || !file || file == loc.file)
+                    continue;
+                bool found = false;
+                for (auto& known : files)
+                    found = found || known.second == file;
+                if (!found)
+                    files.push_back({ file->str(), file });
+            }
+            std::sort(files.begin(), files.end());
+
+            std::vector<uint32_t> ranks(secondaries.size(), 0), order;
+            for (uint32_t idx = 0; idx < secondaries.size(); idx++) {
+                auto file = secondaries[idx]->loc.file;
+                if (secondaries[idx].parent != noParent)
+                    continue;
+                order.push_back(idx);
+                if (!file)
+                    ranks[idx] = noParent;
+                else if (file != loc.file) {
+                    // files with the same path share a rank
+                    for (auto& known : files)
+                        if (known.second == file) {
+                            auto first = std::lower_bound(files.begin(), files.end(), known.first,
+                                [](const std::pair<std::string, SourceFile*>& a, const std::string& path) { return a.first < path; });
+                            ranks[idx] = static_cast<uint32_t>(first - files.begin()) + 1;
+                            break;
+                        }
+                }
+            }
+            std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+                if (ranks[a] != ranks[b])
+                    return ranks[a] < ranks[b];
+                return ranks[a] != noParent && secondaries[a].position < secondaries[b].position;
+            });
+
+            // lay out the top level secondaries in order, then the children of each (in the order they were added)
+            std::vector<uint32_t> newIndex(secondaries.size(), uint32_t(noParent));
+            std::vector<Secondary> sorted;
+            sorted.reserve(secondaries.size());
+            for (auto idx : order) {
+                newIndex[idx] = static_cast<uint32_t>(sorted.size());
+                sorted.push_back(std::move(secondaries[idx]));
+                sorted.back().parent = noParent;
+                sorted.back().childCount = 0;
+            }
+            topCount = static_cast<uint32_t>(sorted.size());
+            for (auto& secondary : secondaries)
+                if (secondary.parent != noParent)
+                    sorted[newIndex[secondary.parent]].childCount++;
+            uint32_t next = topCount;
+            for (uint32_t idx = 0; idx < topCount; idx++) {
+                sorted[idx].firstChild = next;
+                next += sorted[idx].childCount;
+            }
+            sorted.resize(secondaries.size(), Secondary(nullptr, noParent));
+            std::vector<uint32_t> placed(topCount, 0);
+            for (auto& secondary : secondaries) {
+                if (secondary.parent == noParent)
+                    continue;
+                auto parent = newIndex[secondary.parent];
+                auto& slot = sorted[sorted[parent].firstChild + placed[parent]++];
+                slot = std::move(secondary);
+                slot.parent = parent;
+            }
+            secondaries.swap(sorted);
+        }
+        
+        /* prints the bars on the left with the correct indentation */
+        void printLeft(const Config& config, std::ostream& out, uint32_t maxLine, bool printBar = true) {
+            out << std::string(std::to_string(maxLine).size() + config.padding.beforeLineNum + config.padding.afterLineNum, ' ');
+            if (printBar)
+                maybeInherit(config, config.colors.border).print(out, toString(config.chars.borderVertical) + std::string(config.padding.borderLeft, ' '));
+        }
+
+        /* prints the `╭─ file.xyz ─╴` at the start of the file's diagnostics */
+        void printTop(const Config& config, std::ostream& out, SourceFile* file, uint32_t maxLine) {
+            printLeft(config, out, maxLine, false);
+            maybeInherit(config, config.colors.border).print(out, config.chars.beforeFileName); 
+            out << file->str();
+            maybeInherit(config, config.colors.border).print(out, config.chars.afterFileName);
+            out << "\n";
+        }
+
+        /* prints the border at the end of the file's diagnostics */
+        void printBottom(const Config& config, std::ostream& out, uint32_t maxLine) {
+            for (uint8_t i = 0; i < config.padding.borderBottom; i++) {
+                printLeft(config, out, maxLine);
+                out << "\n";
+            }
+            for (size_t i = 0; i < std::to_string(maxLine).size() + config.padding.beforeLineNum + config.padding.afterLineNum; i++)
+                maybeInherit(config, config.colors.border).print(out, toString(config.chars.borderHorizontal));
+            maybeInherit(config, config.colors.border).print(out, toString(config.chars.borderBottomRight));
+            out << "\n";
+        }
+
+        /* prints the bars on the left with the correct indentation + with the line number */
+        void printLeftWithLineNum(const Config& config, std::ostream& out, uint32_t lineNum, uint32_t maxLine, bool printBar = true) {
+            auto targetSize = std::to_string(maxLine).size() + config.padding.beforeLineNum + config.padding.afterLineNum;
+            auto str = std::string(config.padding.beforeLineNum, ' ') + std::to_string(lineNum) + std::string(config.padding.afterLineNum, ' ');
+            while (str.size() < targetSize)
+                str += " ";
+            if (lineNum == loc.line)
+                maybeInherit(config, config.colors.highlightLineNum).print(out, str);
+            else maybeInherit(config, config.colors.lineNum).print(out, str);
+            if (printBar)
+                    maybeInherit(config, config.colors.border).print(out, toString(config.chars.borderVertical) + std::string(config.padding.borderLeft, ' '));
+        }
+
+        /* a 'padding' line is an irrelevant line in between two other relevant lines */
+        void printPadding(const Config& config, std::ostream& out, uint32_t maxLine, uint32_t lastLine, uint32_t currLine, SourceFile *file) {
+            if (lastLine + 2 == currLine) {
+                printLeftWithLineNum(config, out, currLine - 1, maxLine);
+                auto line = file->getLine(currLine - 1);
+                printLine(config, out, line, file, currLine - 1);
+            } else {
+                out << " ";
+                switch (std::to_string(maxLine).size() + config.padding.beforeLineNum + config.padding.afterLineNum) {
+                    case 3:  color(config).print(out, "⋯"); break;
+                    case 4:  color(config).print(out, "··"); break;
+                    default: color(config).print(out, "···"); break;
+                }
+                out << "\n";
+            }
+        }
+
+        /* prints all secondary messages on the current line */
+        void printSecondariesOnLine(const Config& config, std::ostream& out, std::string &line, size_t &i, uint32_t maxLine, bool shownAbove) {
+            auto &first = *secondaries[i];
+            if (!shownAbove && first.loc == loc) { i++; return; }
+            printLeft(config, out, maxLine);
+            
+            if (i + 1 >= topCount || !onSameLine(first, *secondaries[i + 1])) {
+                // only one secondary concerning this line
+                indent(config, out, line, first.loc.start);
+                for (auto idx = first.loc.start; idx < first.loc.end; idx++)
+                    first.color(config).print(out, getUnderline(config, 1, line, idx));
+
+                std::string buffer;
+                auto& text = first.messageText(buffer);
+                auto lines = splitLines(text);
+                
+                for (size_t idx = 0; idx < lines.size(); idx++) {
+                    if (idx != 0) {
+                        printLeft(config, out, maxLine);
+                        indent(config, out, line, first.loc.end);
+                    }
+                    out << " ";
+                    printStyled(out, config, first.color(config), text, first.msgStyle, idx, lines[idx]);
+                    out << "\n";
+                }
+
+                for (uint32_t c = 0; c < secondaries[i].childCount; c++) {
+                    auto& sec = secondaries[secondaries[i].firstChild + c];
+                    std::string childBuffer;
+                    auto& childText = sec->messageText(childBuffer);
+                    lines = splitLines(childText);
+                    for (size_t idx = 0; idx < lines.size(); idx++) {
+                        if (first.hasMessage() || idx != 0) {
+                            printLeft(config, out, maxLine);
+                            indent(config, out, line, sec->loc.end);
+                        }
+                        out << " ";
+                        printStyled(out, config, sec->color(config), childText, sec->msgStyle, idx, lines[idx]);
+                        out << "\n";
+                    }
+                }
+                i++;
+            } else {
+                std::vector<std::vector<const Diagnostic*>> toRender;
+                uint8_t depth = 0;
+                size_t index = i;
+                while (index < topCount && onSameLine(*secondaries[index], first))
+                    index++;
+
+                for (size_t idx = index; idx > i; idx--) {
+                    if (toRender.size() == 0)
+                        toRender.push_back({ secondaries[idx-1].get() });
+                    else {
+                        bool foundClash = false;
                         bool foundOverlap = false;
                         for (auto diag : toRender[depth]) {
-                            if (secondaries[idx-1].loc.start <  diag->loc.end
-                             && secondaries[idx-1].loc.end   >= diag->loc.end) {
+                            if (secondaries[idx-1]->loc.start <  diag->loc.end
+                             && secondaries[idx-1]->loc.end   >= diag->loc.end) {
                                 foundClash = true;
                                 break;
-                            } else if (secondaries[idx-1].loc.start > diag->loc.start
-                                    && secondaries[idx-1].loc.end   < diag->loc.end)
+                            } else if (secondaries[idx-1]->loc.start > diag->loc.start
+                                    && secondaries[idx-1]->loc.end   < diag->loc.end)
                                 foundOverlap = true;
                         }
-                        if (foundClash) {
-                            if (++depth == toRender.size())
-                                toRender.push_back({});
-                            toRender[depth].push_back(&secondaries[idx-1]);
-                        } else {
-                            if (!foundOverlap) {
-                                while (depth != 0) {
-                                    for (auto diag : toRender[depth-1])
-                                        if (secondaries[idx-1].loc.start <  diag->loc.end 
-                                         && secondaries[idx-1].loc.end   >= diag->loc.end
-                                        )
-                                            goto exit;
-                                    depth--;
-                                } 
-                            } exit:
-                            toRender[depth].push_back(&secondaries[idx-1]);
+                        if (foundClash) {
+                            if (++depth == toRender.size())
+                                toRender.push_back({});
+                            toRender[depth].push_back(secondaries[idx-1].get());
+                        } else {
+                            if (!foundOverlap) {
+                                while (depth != 0) {
+                                    for (auto diag : toRender[depth-1])
+                                        if (secondaries[idx-1]->loc.start <  diag->loc.end 
+                                         && secondaries[idx-1]->loc.end   >= diag->loc.end
+                                        )
+                                            goto exit;
+                                    depth--;
+                                } 
+                            } exit:
+                            toRender[depth].push_back(secondaries[idx-1].get());
+                        }
+                    }
+                }
+
+                for (size_t j = 0; j < toRender.size(); j++) {
+                    if (j != 0) {
+                        out << "\n";
+                        printLeft(config, out, maxLine);
+                    }
+                    for (size_t lineIdx = 0; lineIdx < line.size(); lineIdx++) {
+                        int8_t count = 0;
+                        const Diagnostic* lastFound = nullptr;
+                        for (auto curr : toRender[j])
+                            if (curr->loc.start <= lineIdx && lineIdx < curr->loc.end) {
+                                count++;
+                                lastFound = curr;
+                            }
+                        if (!lastFound)
+                            for (auto k = j; count == 0 && k > 0; k--) {
+                                for (auto diag : toRender[k-1])
+                                    if (diag->loc.start == lineIdx) {
+                                        count = -1;
+                                        lastFound = diag;
+                                        break;
+                                    }
+                            }
+                        if (lastFound)
+                            lastFound->color(config).print(out, getUnderline(config, count, line, lineIdx));
+                        else out << getUnderline(config, count, line, lineIdx);
+                    }
+                }
+
+                out << "\n";
+                for (; i < topCount && onSameLine(*secondaries[i], first); i++) {
+                    printLeft(config, out, maxLine);
+                    for (size_t j = 0; j < secondaries[i]->loc.start; j++) {
+                        bool b = false;
+                        for (size_t idx = i; !b && idx < topCount && onSameLine(*secondaries[idx], first); idx++)
+                            if (secondaries[idx]->loc.start == j) {
+                                secondaries[idx]->color(config).print(out, toString(config.chars.lineVertical));
+                                if (line[j] == '\t' && tabWidth(config, j) > 1)
+                                    out << std::string(tabWidth(config, j) - 1, ' ');
+                                b = true;
+                            }
+                        if (!b) indent(config, out, line, 1, j);
+                    }
+                    std::string buffer;
+                    auto& text = secondaries[i]->messageText(buffer);
+                    auto lines = splitLines(text);
+
+                    for (size_t idx = 0; idx < lines.size(); idx++) {
+                        if (idx == 0) {
+                            printStyled(out, config, secondaries[i]->color(config), text, secondaries[i]->msgStyle, idx, lines[idx], config.chars.lineBottomLeft);
+                            out << "\n";
+                        } else {
+                            printLeft(config, out, maxLine);
+                            for (size_t j = 0; j < secondaries[i]->loc.start; j++) {
+                                bool b = false;
+                                for (auto k = i; !b && k < topCount && onSameLine(*secondaries[k], first); k++)
+                                    if (secondaries[k]->loc.start == j) {
+                                        secondaries[k]->color(config).print(out, toString(config.chars.lineVertical));
+                                        if (line[j] == '\t' && tabWidth(config, j) > 1)
+                                            out << std::string(tabWidth(config, j) - 1, ' ');
+                                        b = true;
+                                    }
+                                
+                                if (!b) indent(config, out, line, 1, j);
+                            }
+                            printStyled(out, config, secondaries[i]->color(config), text, secondaries[i]->msgStyle, idx, lines[idx], std::string(countChars(config.chars.lineBottomLeft), ' '));
+                            out << "\n";
+                        }
+                    }
+
+                    for (uint32_t c = 0; c < secondaries[i].childCount; c++) {
+                        auto& sec = secondaries[secondaries[i].firstChild + c];
+                        std::string childBuffer;
+                        auto& childText = sec->messageText(childBuffer);
+                        lines = splitLines(childText);
+
+                        for (size_t idx = 0; idx < lines.size(); idx++) {
+                            if (!secondaries[i]->hasMessage() && idx == 0) {
+                                secondaries[i]->color(config).print(out, config.chars.lineBottomLeft);
+                                printStyled(out, config, sec->color(config), childText, sec->msgStyle, idx, lines[idx]);
+                                out << "\n";
+                            } else {
+                                printLeft(config, out, maxLine);
+                                for (size_t j = 0; j < sec->loc.start; j++) {
+                                    bool b = false;
+                                    for (auto k = i; !b && k < topCount && onSameLine(*secondaries[k], first); k++)
+                                        if (secondaries[k]->loc.start == j) {
+                                            secondaries[k]->color(config).print(out, toString(config.chars.lineVertical));
+                                            if (line[j] == '\t' && tabWidth(config, j) > 1)
+                                                out << std::string(tabWidth(config, j) - 1, ' ');
+                                            b = true;
+                                        }
+                                    
+                                    if (!b) indent(config, out, line, 1, j);
+                                }
+                                printStyled(out, config, sec->color(config), childText, sec->msgStyle, idx, lines[idx], std::string(countChars(config.chars.lineBottomLeft), ' '));
+                                out << "\n";
+                            }
+                        }
+                    }
+                }
+            }
+        }
+
+        /* prints the backtrace of the diagnostic, innermost frame first, eliding repeated frames and frames past the depth limit */
+        void printBacktrace(const Config& config, std::ostream& out, uint32_t maxLine) {
+            if (!traces || frame == Backtraces::none)
+                return;
+            auto frames = backtrace(config);
+            size_t printed = 0;
+            for (size_t i = 0; i < frames.size(); i++) {
+                if (config.limits.backtrace && printed == config.limits.backtrace) {
+                    printLeft(config, out, maxLine, false);
+                    config.colors.note.print(out, "  ... " + std::to_string(frames.size() - i) + (frames.size() - i == 1 ? " more frame" : " more frames"));
+                    out << "\n";
+                    break;
+                }
+                auto& f = frames[i];
+                size_t repeats = 0;
+                while (i + 1 < frames.size() && frames[i + 1].label == f.label && frames[i + 1].loc == f.loc) {
+                    repeats++;
+                    i++;
+                }
+                printLeft(config, out, maxLine, false);
+                config.colors.note.print(out, (printed ? "  " : toString(config.chars.noteBullet) + " ") + f.label);
+                if (f.loc.file)
+                    out << " " << f.loc.file->str() << ":" << f.loc.line << ":" << f.loc.start;
+                if (repeats)
+                    config.colors.note.print(out, " (repeated " + std::to_string(repeats) + " more times)");
+                out << "\n";
+                printed++;
+            }
+        }
+
+        /* prints every line changed by the fix-its, with the fix-its applied and the replacements underlined */
+        void printFixIts(const Config& config, std::ostream& out, uint32_t maxLine) {
+            std::vector<FixIt> fixes;
+            for (auto& fix : fixits)
+                if (fix.loc.file)
+                    fixes.push_back(fix);
+            std::stable_sort(fixes.begin(), fixes.end(), [](const FixIt& a, const FixIt& b) {
+                if (a.loc.file != b.loc.file)
+                    return a.loc.file->str() < b.loc.file->str();
+                if (a.loc.line != b.loc.line)
+                    return a.loc.line < b.loc.line;
+                return a.loc.start < b.loc.start;
+            });
+            for (size_t i = 0; i < fixes.size();) {
+                auto file = fixes[i].loc.file;
+                auto lineNum = fixes[i].loc.line;
+                auto line = file->getLine(lineNum);
+
+                std::string fixed;
+                std::vector<std::pair<size_t, size_t>> marks; // replaced parts of `fixed`
+                size_t pos = 0;
+                for (; i < fixes.size() && fixes[i].loc.file == file && fixes[i].loc.line == lineNum; i++) {
+                    auto& fix = fixes[i];
+                    if (fix.loc.start < pos || fix.loc.start > line.size())
+                        continue; // overlaps the previous fix-it
+                    fixed += line.substr(pos, fix.loc.start - pos);
+                    marks.push_back({ fixed.size(), fixed.size() + std::max<size_t>(fix.replacement.size(), 1) });
+                    fixed += fix.replacement;
+                    pos = std::min<size_t>(fix.loc.end, line.size());
+                }
+                fixed += line.substr(pos);
+
+                printLeft(config, out, maxLine, false);
+                config.colors.help.print(out, toString(config.chars.noteBullet) + " " + config.chars.fixName + ": ");
+                out << file->str() << ":" << lineNum << "\n";
+                printLeftWithLineNum(config, out, lineNum, maxLine);
+                printLine(config, out, fixed);
+                printLeft(config, out, maxLine);
+                size_t col = 0;
+                for (auto& mark : marks) {
+                    indent(config, out, fixed, static_cast<uint32_t>(mark.first - col), col);
+                    for (col = mark.first; col < mark.second; col++)
+                        config.colors.help.print(out, col < fixed.size() ? getUnderline(config, 1, fixed, col) : toString(config.chars.underlineA));
+                }
+                out << "\n";
+            }
+        }
+
+    protected:
+        Diagnostic(DiagnosticType ty, std::string message, std::string subMessage, std::string diagCode, Location location) 
+               : msg(message), subMsg(subMessage), loc(location), errTy(ty), kindTable(DiagnosticKind::of(ty)), code(diagCode) {}
+        Diagnostic(DiagnosticType ty, std::string message, std::string subMessage, Location location) : Diagnostic(ty, message, subMessage, "", location) {}
+        Diagnostic(DiagnosticType ty, std::string message, Location location) : Diagnostic(ty, message, "", location) {}
+        Diagnostic(DiagnosticType ty, std::string message) : Diagnostic(ty, message, {}) {}
+        Diagnostic(DiagnosticType ty, const MessageTemplate& message, std::vector<std::string> arguments, std::string subMessage, std::string diagCode, Location location) 
+               : Diagnostic(ty, "", subMessage, diagCode, location) {
+            tmpl = &message;
+            args = std::move(arguments);
+        }
+        Diagnostic(DiagnosticType ty, const StyledText& message, const StyledText& subMessage, std::string diagCode, Location location)
+               : Diagnostic(ty, message.text(), subMessage.text(), diagCode, location) {
+            msgStyle = message.spans();
+            subMsgStyle = subMessage.spans();
+        }
+
+    private:
+        /* whether the diagnostic has a main message */
+        bool hasMessage() const {
+            return tmpl ? tmpl->slots() != 0 || tmpl->text() != "" : msg != "";
+        }
+
+        /* the main message, formatted into `buffer` first if it is made from a template */
+        const std::string& messageText(std::string& buffer) const {
+            return tmpl ? (buffer = tmpl->format(args)) : msg;
+        }
+
+        /* prints the main message, replacing newlines with `lineSeparator` if it isn't null */
+        void printMessage(std::ostream& out, const Config& config, const colors::Color& color, const std::string* lineSeparator = nullptr) const {
+            if (!tmpl && !msgStyle.empty()) {
+                auto lines = splitLines(msg);
+                for (size_t idx = 0; idx < lines.size(); idx++) {
+                    if (idx && lineSeparator)
+                        color.print(out, *lineSeparator);
+                    else if (idx)
+                        color.print(out, "\n");
+                    printStyled(out, config, color, msg, msgStyle, idx, lines[idx]);
+                }
+                return;
+            }
+            if (!tmpl) {
+                color.print(out, lineSeparator ? replaceAll(msg, "\n", *lineSeparator) : msg);
+                return;
+            }
+            if (lineSeparator) {
+                color.print(out, replaceAll(tmpl->format(args), "\n", *lineSeparator));
+                return;
+            }
+            color.begin(out);
+            tmpl->write(out, args);
+            out << rang::style::reset;
+        }
+
+        /* pretty-print the diagnostic at its locations as they are */
+        Diagnostic& render(std::ostream& out, const Config& config) {
+
+            // sort the vector of secondary messages based on the order we want to be printing them 
+            sortSecondaries();
+
+            if (config.style == DisplayStyle::SHORT) {
+                if (loc.file)
+                    out << loc.file->str() << ":" << loc.line << ":" << loc.start << ":" << loc.end << ": ";
+                color(config).print(out, tyToString(config) + ": ");
+                printMessage(out, config, maybeInherit(config, config.colors.message), &config.chars.shortModeLineSeperator);
+                out << "\n";
+                for (uint32_t k = 0; k < topCount; k++) {
+                    // each top level secondary, followed by its children
+                    for (uint32_t c = 0; c <= secondaries[k].childCount; c++) {
+                        auto& i = secondaries[c ? secondaries[k].firstChild + c - 1 : k];
+                        if (i->loc.file) 
+                            out << i->loc.file->str() << ":" << i->loc.line << ":" << i->loc.start << ":" << i->loc.end << ": ";
+                        i->color(config).print(out, i->tyToString(config) + ": ");
+                        std::string buffer;
+                        out << replaceAll(i->messageText(buffer), "\n", config.chars.shortModeLineSeperator) << "\n";
+                    }
+                }
+                if (traces && frame != Backtraces::none) {
+                    auto frames = backtrace(config);
+                    for (size_t k = 0; k < frames.size() && (!config.limits.backtrace || k < config.limits.backtrace); k++) {
+                        if (frames[k].loc.file)
+                            out << frames[k].loc.file->str() << ":" << frames[k].loc.line << ":" << frames[k].loc.start << ":" << frames[k].loc.end << ": ";
+                        config.colors.note.print(out, config.chars.noteName + ": ");
+                        out << frames[k].label << "\n";
+                    }
+                }
+                for (auto& fix : fixits) {
+                    if (!fix.loc.file) continue;
+                    out << fix.loc.file->str() << ":" << fix.loc.line << ":" << fix.loc.start << ":" << fix.loc.end << ": ";
+                    config.colors.help.print(out, config.chars.fixName + ": ");
+                    out << "\"" << fix.replacement << "\"\n";
+                }
+                return *this;
+            }
+
+            // find the maximum line (to know by how much to indent the bars)
+            auto maxLine = loc.line;
+            for (uint32_t k = 0; k < topCount; k++)
+                if (secondaries[k]->loc.line > maxLine)
+                    maxLine = secondaries[k]->loc.line;
+            for (auto& fix : fixits)
+                if (fix.loc.line > maxLine)
+                    maxLine = fix.loc.line;
+
+            // read the files of all the sections up front and in parallel, rather than waiting on each file in turn
+            readFiles(config);
+
+            // by default we're pointing at the error location from below the code snippet
+            bool printAbove = false; 
+
+            // if there are any messages on the line of the error, point to the error from above instead
+            for (uint32_t k = 0; k < topCount; k++)
+                if (onSameLine(*secondaries[k], *this) && secondaries[k]->loc != loc) {
+                    printAbove = true;
+                    break;
+                }
+
+            // print the main error message
+            if (hasMessage()) {
+                color(config).print(out, tyToString(config) + ": ");
+                printMessage(out, config, maybeInherit(config, config.colors.message));
+                out << "\n";
+            }
+
+            size_t i = 0; // current index in `secondaries`
+            uint32_t lastLine = 0; // the last line we rendered
+            std::string line = ""; // the snippet we're going to print
+
+            // skip to after the diagnostic's location is printed if it has no location 
+            if (loc.file == nullptr) goto afterSubMsg;
+
+            // print the file the error is in
+            printTop(config, out, loc.file, maxLine);
+
+            // top padding
+            for (uint8_t idx = 0; idx < config.padding.borderTop - 1; idx++) {
+                printLeft(config, out, maxLine);
+                out << "\n";
+            }
+
+            // first print all messages in the main file which come before the error
+            while (i < topCount && secondaries[i]->loc.file == loc.file && secondaries[i]->loc.line < loc.line) {
+                auto &secondary = *secondaries[i];
+
+                if (lastLine == 0 && config.padding.borderTop != 0) { // if we're rendering the first line in the file, print an empty line
+                    printLeft(config, out, maxLine); 
+                    out << "\n";
+                } else if (lastLine != 0 && lastLine < secondary.loc.line - 1)
+                    printPadding(config, out, maxLine, lastLine, secondary.loc.line, secondary.loc.file);
+
+                lastLine = secondary.loc.line;
+                line = loc.file->getLine(secondary.loc.line);
+                printLeftWithLineNum(config, out, secondary.loc.line, maxLine);
+                printLine(config, out, line, loc.file, secondary.loc.line);
+                printSecondariesOnLine(config, out, line, i, maxLine, printAbove);
+            }
+
+            line = loc.file->getLine(loc.line);
+
+            if (lastLine == 0 && !printAbove && config.padding.borderTop != 0) {
+                printLeft(config, out, maxLine);
+                out << "\n";
+            } else if (lastLine != 0 && lastLine < loc.line - 1)
+                printPadding(config, out, maxLine, lastLine, loc.line, loc.file);
+            lastLine = loc.line;
+            
+            if (printAbove) {
+                if (subMsg != "") {
+                    auto split = splitLines(subMsg);
+                    for (size_t k = 0; k < split.size(); k++) {
+                        printLeft(config, out, maxLine);
+                        indent(config, out, line, loc.start);
+                        printStyled(out, config, color(config), subMsg, subMsgStyle, k, split[k]);
+                        out << "\n";
+                    }
+                }
+                
+                printLeft(config, out, maxLine);
+
+                indent(config, out, line, loc.start);
+                for (auto j = loc.start; j < loc.end; j++)
+                    if (line[j] == '\t')
+                        color(config).print(out, repeat(toString(config.chars.arrowDown), tabWidth(config, j)));
+                    else color(config).print(out, toString(config.chars.arrowDown));
+                out << "\n";
+            }
+            
+            printLeftWithLineNum(config, out, loc.line, maxLine);
+            printLine(config, out, line, loc.file, loc.line);
+
+            if (!printAbove) {
+                printLeft(config, out, maxLine);
+                indent(config, out, line, loc.start);
+                for (auto j = loc.start; j < loc.end; j++)
+                    if (line[j] == '\t')
+                        color(config).print(out, repeat(toString(config.chars.arrowUp), tabWidth(config, j)));
+                    else color(config).print(out, toString(config.chars.arrowUp));
+                if (subMsg == "")
+                    out << "\n";
+                else {
+                    auto split = splitLines(subMsg);
+                    for (size_t k = 0; k < split.size(); k++) {
+                        if (k) {
+                            printLeft(config, out, maxLine);
+                            indent(config, out, line, loc.end);
+                        }
+                        out << " ";
+                        printStyled(out, config, color(config), subMsg, subMsgStyle, k, split[k]);
+                        out << "\n";
+                    }
+                }
+                for (size_t j = i; j < topCount && secondaries[j]->loc.file == loc.file && secondaries[j]->loc.line == loc.line; j++) {
+                    if (secondaries[j]->loc == loc) {
+                        std::string buffer;
+                        auto& text = secondaries[j]->messageText(buffer);
+                        auto split = splitLines(text);
+                        for (size_t k = 0; k < split.size(); k++) {
+                            printLeft(config, out, maxLine);
+                            indent(config, out, line, loc.end);
+                            out << " ";
+                            printStyled(out, config, secondaries[j]->color(config), text, secondaries[j]->msgStyle, k, split[k]);
+                            out << "\n";
                         }
                     }
                 }
+            }
+        
+            if (i < topCount && onSameLine(*secondaries[i], *this))
+                printSecondariesOnLine(config, out, line, i, maxLine, printAbove);
+
+        afterSubMsg:    
+            auto currFile = loc.file;
+            while (i < topCount && secondaries[i]->loc.file) {
+                auto &secondary = *secondaries[i];
+                if (currFile == nullptr || secondary.loc.file->str() != currFile->str()) {
+                    if (currFile != nullptr)                    
+                        printBottom(config, out, maxLine);
+                    currFile = secondary.loc.file;
+                    printTop(config, out, currFile, maxLine);
+                    for (uint8_t k = 0; k < config.padding.borderTop; k++) {
+                        printLeft(config, out, maxLine);
+                        out << "\n";
+                    }
+                } else if (lastLine < secondary.loc.line - 1)
+                    printPadding(config, out, maxLine, lastLine, secondary.loc.line, secondary.loc.file);
+
+                lastLine = secondary.loc.line;
+                line = currFile->getLine(secondary.loc.line);
+                printLeftWithLineNum(config, out, secondary.loc.line, maxLine);
+                printLine(config, out, line, currFile, secondary.loc.line);
+                printSecondariesOnLine(config, out, line, i, maxLine, printAbove);
+            }
+            if (currFile != nullptr)
+                printBottom(config, out, maxLine); 
+            printBacktrace(config, out, maxLine);
+            printFixIts(config, out, maxLine);
+            for (; i < topCount; i++) {
+                auto& secondary = *secondaries[i];
+                printLeft(config, out, maxLine, false);
+                secondary.color(config).print(out, toString(config.chars.noteBullet) + " " + secondary.tyToString(config) + ": ");
+
+                std::string buffer;
+                auto& text = secondary.messageText(buffer);
+                auto lines = splitLines(text);
+                
+                for (size_t idx = 0; idx < lines.size(); idx++) {
+                    if (idx != 0) {
+                        printLeft(config, out, maxLine, false);
+                        out << std::string(secondary.tyWidth(config) + 4, ' ');
+                    }
+                    if (secondary.msgStyle.empty())
+                        printLine(config, out, lines[idx]);
+                    else {
+                        printStyled(out, config, colors::none, text, secondary.msgStyle, idx, lines[idx]);
+                        out << "\n";
+                    }
+                }
+            }
+            return *this;
+        }
+
+        /* the frames of the diagnostic's backtrace, innermost first, with locations in generated code moved to their origin */
+        std::vector<Backtraces::Node> backtrace(const Config& config) const {
+            auto frames = traces->get(frame);
+            if (config.sourceMap)
+                for (auto& f : frames)
+                    config.sourceMap->translate(f.loc);
+            return frames;
+        }
+
+        /* whether any location of the diagnostic (except for its backtrace) is in generated code */
+        bool generated(const SourceMap& map) const {
+            auto inMap = [&map](Location at) { return map.translate(at); };
+            if (inMap(loc))
+                return true;
+            for (auto& secondary : secondaries)
+                if (inMap(secondary->loc))
+                    return true;
+            for (auto& fix : fixits)
+                if (inMap(fix.loc))
+                    return true;
+            return false;
+        }
+
+        /* move every location in generated code to its origin, returns whether any location was moved */
+        bool translate(const SourceMap& map, bool noteGenerated = true) {
+            bool moved = false;
+            auto generated = loc;
+            if (map.translate(loc)) {
+                moved = true;
+                if (noteGenerated)
+                    with(Diagnostic(DiagnosticType::NOTE, "generated code at " + generated.file->str() + ":" 
+                                    + std::to_string(generated.line) + ":" + std::to_string(generated.start)));
+            }
+            for (auto& secondary : secondaries) {
+                auto at = secondary->loc;
+                if (!map.translate(at))
+                    continue;
+                // secondaries may be shared with other diagnostics, so translate a copy
+                auto copy = std::make_shared<Diagnostic>(*secondary);
+                copy->loc = at;
+                copy->secondaries.clear(); // already flattened into this diagnostic
+                secondary.diag = copy;
+                secondary.position = Secondary::positionOf(at);
+                moved = true;
+            }
+            for (auto& fix : fixits)
+                moved = map.translate(fix.loc) || moved;
+            return moved;
+        }
+
+        /* read the files which are about to be printed and weren't read yet, on up to `config.readThreads` threads */
+        void readFiles(const Config& config) const {
+            if (config.readThreads < 2)
+                return;
+            std::vector<SourceFile*> files;
+            auto add = [&files](SourceFile* file) {
+                // secondaries are sorted by file, so a file's secondaries are next to each other
+                if (file && (files.empty() || files.back() != file) && !file->indexed())
+                    files.push_back(file);
+            };
+            add(loc.file);
+            for (uint32_t k = 0; k < topCount; k++)
+                add(secondaries[k]->loc.file);
+            for (auto& fix : fixits)
+                add(fix.loc.file);
+            if (files.size() < 2)
+                return;
+
+            std::atomic<size_t> next(0);
+            auto work = [&files, &next] {
+                for (size_t idx; (idx = next++) < files.size();)
+                    files[idx]->index();
+            };
+            std::vector<std::thread> workers;
+            for (size_t t = 1; t < config.readThreads && t < files.size(); t++)
+                workers.emplace_back(work);
+            work();
+            for (auto& worker : workers)
+                worker.join();
+        }
+
+        /* whether the diagnostic may have more secondaries than the config's limits allow */
+        bool overBudget(const Config& config) const {
+            auto& limits = config.limits;
+            size_t count = secondaries.size();
+            return (limits.secondariesPerFile && count > limits.secondariesPerFile)
+                || (limits.files && count + 1 > limits.files)
+                || (limits.lines && count + 1 > limits.lines);
+        }
+
+        /* drop the secondaries beyond the config's limits - before any of them is read or laid out - and note how many were dropped */
+        bool elide(const Config& config) {
+            if (!overBudget(config))
+                return false;
+            sortSecondaries();
+            auto& limits = config.limits;
+            std::vector<bool> keep(topCount, false);
+            size_t elided = 0, elidedHelp = 0;
+            size_t files = loc.file ? 1 : 0, lines = loc.file ? 1 : 0;
+            SourceFile* current = loc.file;
+            uint32_t inFile = 0, lastLine = 0;
+            for (uint32_t k = 0; k < topCount; k++) {
+                auto& at = secondaries[k]->loc;
+                bool newFile = at.file && at.file != current;
+                bool newLine = !at.file || newFile || (at.line != lastLine && !(at.file == loc.file && at.line == loc.line));
+                bool fits = (!newFile || !limits.files || files < limits.files)
+                         && (!at.file || !limits.secondariesPerFile || (newFile ? 0 : inFile) < limits.secondariesPerFile)
+                         && (!newLine || !limits.lines || lines < limits.lines);
+                if (!fits) {
+                    elided += 1 + secondaries[k].childCount;
+                    for (uint32_t c = 0; c <= secondaries[k].childCount; c++)
+                        if (secondaries[c ? secondaries[k].firstChild + c - 1 : k]->errTy == DiagnosticType::HELP)
+                            elidedHelp++;
+                    continue;
+                }
+                keep[k] = true;
+                if (newFile) {
+                    current = at.file;
+                    files++;
+                    inFile = 0;
+                }
+                if (newLine)
+                    lines++;
+                if (at.file) {
+                    inFile++;
+                    lastLine = at.line;
+                }
+            }
+            if (!elided)
+                return false;
+
+            std::vector<Secondary> kept;
+            std::vector<uint32_t> newIndex(topCount, uint32_t(noParent));
+            for (uint32_t k = 0; k < topCount; k++) {
+                if (!keep[k]) continue;
+                newIndex[k] = static_cast<uint32_t>(kept.size());
+                kept.push_back(secondaries[k]);
+            }
+            for (uint32_t k = topCount; k < secondaries.size(); k++) {
+                if (!keep[secondaries[k].parent]) continue;
+                kept.push_back(secondaries[k]);
+                kept.back().parent = newIndex[secondaries[k].parent];
+            }
+            secondaries.swap(kept);
+            auto notes = elided - elidedHelp;
+            std::string summary = notes ? "and " + std::to_string(notes) + " more note" + (notes == 1 ? "" : "s") : "";
+            if (elidedHelp)
+                summary += (notes ? " and " : "and ") + std::to_string(elidedHelp) + " more help message" + (elidedHelp == 1 ? "" : "s");
+            with(Diagnostic(DiagnosticType::NOTE, summary));
+            return true;
+        }
+
+        /* hash of the diagnostic without its secondaries */
+        uint64_t hashOwn() const {
+            uint64_t h = 14695981039346656037ULL; // FNV-1a
+            auto add = [&h](const void* data, size_t size) {
+                for (size_t i = 0; i < size; i++)
+                    h = (h ^ static_cast<const uint8_t*>(data)[i]) * 1099511628211ULL;
+            };
+            auto addStr = [&add](const std::string& str) { add(str.data(), str.size() + 1); };
+            auto addSpans = [&add](const std::vector<StyledText::Span>& spans) {
+                // field by field, the padding of a span isn't initialized
+                for (auto& span : spans) {
+                    add(&span.start, sizeof(span.start));
+                    add(&span.end, sizeof(span.end));
+                    add(&span.style, sizeof(span.style));
+                }
+                auto size = spans.size();
+                add(&size, sizeof(size));
+            };
+            add(&errTy, sizeof(errTy));
+            addStr(kindTable->key);
+            addStr(code);
+            addStr(msg);
+            if (tmpl) {
+                addStr(tmpl->text());
+                for (auto& arg : args)
+                    addStr(arg);
+            }
+            addStr(subMsg);
+            addSpans(msgStyle);
+            addSpans(subMsgStyle);
+            add(&loc.file, sizeof(loc.file));
+            add(&loc.line, sizeof(loc.line));
+            add(&loc.start, sizeof(loc.start));
+            add(&loc.end, sizeof(loc.end));
+            add(&frame, sizeof(frame));
+            for (auto& fix : fixits) {
+                add(&fix.loc.line, sizeof(fix.loc.line));
+                add(&fix.loc.start, sizeof(fix.loc.start));
+                add(&fix.loc.end, sizeof(fix.loc.end));
+                addStr(fix.replacement);
+            }
+            return h;
+        }
+
+    public:
+        /**
+         * Pretty-print the diagnostic.
+         * If the config has a source map, locations in generated code are printed at their origin, along with a note with the generated location.
+         * Secondaries beyond the config's limits (`secondariesPerFile`, `files` and `lines`) are left out, and summarized by an "and N more notes and M more help messages" note.
+         * @param out stream in which to print the error.
+         * @return the object which this function was called upon.
+         */
+        Diagnostic& print(std::ostream& out, const Config& config) {
+            // only copy the diagnostic if something has to change
+            bool mapped = config.sourceMap && generated(*config.sourceMap);
+            if (mapped || overBudget(config)) {
+                Diagnostic copy = *this;
+                bool changed = mapped && copy.translate(*config.sourceMap);
+                changed = copy.elide(config) || changed;
+                if (changed) {
+                    copy.render(out, config);
+                    return *this;
+                }
+            }
+            return render(out, config);
+        }
+
+        Diagnostic& print(std::ostream& out, const Config&& config = Config()) { return print(out, config); }
+
+        /** @return the diagnostic's type, which is the severity of its kind for user-defined kinds. */
+        DiagnosticType type() const { return errTy; }
+
+        /** @return the diagnostic's kind. */
+        const DiagnosticKind* kind() const { return kindTable; }
+
+        /** @return the main message of the diagnostic, formatted if it was made from a `MessageTemplate`. */
+        std::string message() const { return tmpl ? tmpl->format(args) : msg; }
+
+        /** @return the template the main message is made from, or nullptr if it isn't made from a template. */
+        const MessageTemplate* messageTemplate() const { return tmpl; }
+
+        /** @return the submessage which is printed next to the source code. */
+        const std::string& subMessage() const { return subMsg; }
+
+        /** @return the main message along with its styled spans, e.g. for writing it as HTML. */
+        StyledText styledMessage() const { return StyledText(message(), msgStyle); }
+
+        /** @return the submessage along with its styled spans. */
+        StyledText styledSubMessage() const { return StyledText(subMsg, subMsgStyle); }
+
+        /** @return the error code, or an empty string if there is none. */
+        const std::string& errorCode() const { return code; }
+
+        /** @return the source code location the diagnostic is concerning. */
+        const Location& location() const { return loc; }
+
+        /** @return the suggested edits of the diagnostic. */
+        const std::vector<FixIt>& fixIts() const { return fixits; }
+
+        /**
+         * Hash of everything which is rendered - type, code, messages, location and secondaries.
+         * Two diagnostics with the same hash are rendered the same way.
+         */
+        uint64_t hash() const {
+            // the secondaries of a secondary are flattened into this diagnostic, so each one only hashes its own parts, along with
+            // its parent's. Printing reorders the secondaries and their parent indices, so they're hashed in an order of their own
+            std::vector<std::pair<uint64_t, uint64_t>> entries;
+            entries.reserve(secondaries.size());
+            for (auto& secondary : secondaries)
+                entries.emplace_back(secondary->hashOwn(), secondary.parent == noParent ? 0 : secondaries[secondary.parent]->hashOwn());
+            std::sort(entries.begin(), entries.end());
+            uint64_t h = hashOwn();
+            for (auto& entry : entries) {
+                uint64_t sub[2] = { entry.first, entry.second };
+                for (size_t i = 0; i < sizeof(sub); i++)
+                    h = (h ^ reinterpret_cast<const uint8_t*>(sub)[i]) * 1099511628211ULL;
+            }
+            return h;
+        }
+
+        /** @return whether the diagnostic is an error or an internal error. */
+        bool isError() const {
+            return errTy == DiagnosticType::ERROR || errTy == DiagnosticType::INTERNAL_ERROR || errTy == DiagnosticType::UNKNOWN;
+        }
+
+        /**
+         * Empty the diagnostic, keeping the capacity of its strings and vectors so it can be refilled without allocating.
+         * The type is kept as well.
+         * @return the object which this function was called upon.
+         */
+        Diagnostic& clear() {
+            msg.clear();
+            subMsg.clear();
+            msgStyle.clear();
+            subMsgStyle.clear();
+            loc = Location();
+            code.clear();
+            secondaries.clear();
+            topCount = 0;
+            fixits.clear();
+            tmpl = nullptr;
+            args.clear();
+            traces = nullptr;
+            frame = Backtraces::none;
+            return *this;
+        }
+
+        /**
+         * Adds a secondary note message to the diagnostic at `location`.
+         * @param message the note message.
+         * @param location source code location of the note message.
+         * @return the object which this function was called upon.
+         */
+        inline Diagnostic& withNote(std::string message, Location location);
+        
+        /**
+         * Adds a secondary help message to the diagnostic at `location`.
+         * @param message the help message.
+         * @param location source code location of the help message.
+         * @return the object which this function was called upon.
+         */
+        inline Diagnostic& withHelp(std::string message, Location location);
+
+        /**
+         * Adds a secondary note message to the diagnostic without a specific location.
+         * @param message the note message.
+         * @return the object which this function was called upon.
+         */
+        inline Diagnostic& withNote(std::string message) { return withNote(message, {}); }
+
+        /**
+         * Adds a secondary help message to the diagnostic without a specific location.
+         * @param message the help message.
+         * @return the object which this function was called upon.
+         */
+        Diagnostic& withHelp(std::string message) { return withHelp(message, {}); }
+
+        /**
+         * Adds a secondary note message with styled spans to the diagnostic.
+         * @param message the note message.
+         * @param location source code location of the note message.
+         * @return the object which this function was called upon.
+         */
+        inline Diagnostic& withNote(const StyledText& message, Location location = {});
+
+        /**
+         * Adds a secondary help message with styled spans to the diagnostic.
+         * @param message the help message.
+         * @param location source code location of the help message.
+         * @return the object which this function was called upon.
+         */
+        inline Diagnostic& withHelp(const StyledText& message, Location location = {});
+
+        /**
+         * Sets the backtrace of the diagnostic (e.g. the macro expansions and includes it is in), rendered below its snippets.
+         * @param backtraces the storage of the backtrace, must outlive the diagnostic.
+         * @param innermost the innermost frame of the backtrace.
+         * @return the object which this function was called upon.
+         */
+        Diagnostic& withBacktrace(const Backtraces& backtraces, Backtraces::Frame innermost) {
+            traces = &backtraces;
+            frame = innermost;
+            return *this;
+        }
+
+        /**
+         * Adds a "did you mean" help message to the diagnostic (see `Suggester`).
+         * @param candidates the suggested names, best first. Nothing is added if there are none.
+         * @param location source code location of the help message.
+         * @return the object which this function was called upon.
+         */
+        Diagnostic& withSuggestions(const std::vector<std::string>& candidates, Location location = {}) {
+            if (candidates.empty())
+                return *this;
+            std::string message = candidates.size() == 1 ? "did you mean " : "did you mean one of ";
+            for (size_t i = 0; i < candidates.size(); i++)
+                message += (i ? ", '" : "'") + candidates[i] + "'";
+            return withHelp(message + "?", location);
+        }
+
+        /**
+         * Adds a suggested edit to the diagnostic, rendered below the diagnostic's snippets.
+         * Fix-its of many diagnostics can be applied to their files with a `FixItApplier`.
+         * @param location source code location to be replaced.
+         * @param replacement the text to replace it with.
+         * @return the object which this function was called upon.
+         */
+        Diagnostic& withFixIt(Location location, std::string replacement) {
+            fixits.push_back({ location, std::move(replacement) });
+            return *this;
+        }
+
+        /**
+         * Adds a secondary message which may be shared with other diagnostics (see `share`).
+         * Attaching a shared secondary only copies a pointer, no matter how large the secondary is.
+         * @param secondary the secondary message.
+         * @return the object which this function was called upon.
+         */
+        Diagnostic& withShared(std::shared_ptr<const Diagnostic> secondary) { return with(std::move(secondary)); }
+
+    private:
+        Diagnostic& with(Diagnostic diag) { return with(std::make_shared<const Diagnostic>(std::move(diag))); }
+
+        Diagnostic& with(std::shared_ptr<const Diagnostic> diag) {
+            uint32_t parent = noParent;
+            if (diag->loc.file != nullptr) 
+                for (uint32_t idx = 0; idx < secondaries.size(); idx++)
+                    if (secondaries[idx].parent == noParent && secondaries[idx]->loc == diag->loc) {
+                        parent = idx;
+                        break;
+                    }
+            // the secondaries of `diag` are flattened into this diagnostic, attached to the same top level secondary as `diag`
+            auto attachTo = parent == noParent ? static_cast<uint32_t>(secondaries.size()) : parent;
+            auto& nested = diag->secondaries;
+            secondaries.reserve(secondaries.size() + 1 + nested.size());
+            secondaries.emplace_back(diag, parent);
+            for (auto& child : nested)
+                secondaries.emplace_back(child.diag, attachTo);
+            return *this; 
+        }
+    };
+
+    /////////////////////////////////////////////////////////////////////////
+
+    /**
+     * A diagnostic of the kind `Kind`, either a `BuiltinKind` or a user-defined one (see `BuiltinKind`).
+     */
+    template<typename Kind>
+    class DiagnosticTy : public Diagnostic {
+    public:
+        /**
+         * Constructs a minimal diagnostic message, without a specific source code location.
+         * @param message the diagnostic message - should essentially be the 'title' of the diagnostic without going into too much detail.
+         */
+        DiagnosticTy<Kind>(std::string message) : Diagnostic(Kind::severity, message) { kindTable = DiagnosticKind::of<Kind>(); }
+
+        /**
+         * Constructs a simple diagnostic with a message and a source code location.
+         * @param message the diagnostic message - should essentially be the 'title' of the diagnostic without going into too much detail.
+         * @param location the location the diagnostic is concerning.
+         */
+        DiagnosticTy<Kind>(std::string message, Location location) : Diagnostic(Kind::severity, message, location) { kindTable = DiagnosticKind::of<Kind>(); }
+
+        /**
+         * Constructs a diagnostic at a specific source code location with both a primary message and a submessage.
+         * @param message the diagnostic message - should essentially be the 'title' of the diagnostic without going into too much detail.
+         * @param subMessage the secondary message which is printed directly next to the source code.
+         * @param location the location the diagnostic is concerning.
+         */
+        DiagnosticTy<Kind>(std::string message, std::string subMessage, Location location) : Diagnostic(Kind::severity, message, subMessage, location) { kindTable = DiagnosticKind::of<Kind>(); }
+
+        /**
+         * Constructs a diagnostic at a specific source code location with both a primary message and a submessage, as well as a custom error code.
+         * @param message the diagnostic message - should essentially be the 'title' of the diagnostic without going into too much detail.
+         * @param subMessage the secondary message which is printed directly next to the source code.
+         * @param code the error code, can be anything but is usually something like `"E101"` or `"W257"`, for example.
+         * @param location the location the diagnostic is concerning.
+         */
+        DiagnosticTy<Kind>(std::string message, std::string subMessage, std::string code, Location location) : Diagnostic(Kind::severity, message, subMessage, code, location) { kindTable = DiagnosticKind::of<Kind>(); }
+
+        /**
+         * Constructs a diagnostic whose message has styled spans, e.g. StyledText("use of undeclared type `Foo`").
+         * @param message the diagnostic message.
+         * @param location the location the diagnostic is concerning.
+         */
+        DiagnosticTy<Kind>(const StyledText& message, Location location = {}) : Diagnostic(Kind::severity, message, StyledText(), "", location) { kindTable = DiagnosticKind::of<Kind>(); }
+
+        /**
+         * Constructs a diagnostic whose message and submessage have styled spans, e.g. StyledText("use of undeclared type `Foo`").
+         * @param message the diagnostic message.
+         * @param subMessage the secondary message which is printed directly next to the source code.
+         * @param code the error code.
+         * @param location the location the diagnostic is concerning.
+         */
+        DiagnosticTy<Kind>(const StyledText& message, const StyledText& subMessage, std::string code, Location location) : Diagnostic(Kind::severity, message, subMessage, code, location) { kindTable = DiagnosticKind::of<Kind>(); }
+
+        /**
+         * Constructs a diagnostic whose message is made from a template.
+         * @param message the message template, must outlive the diagnostic.
+         * @param args the arguments filling the template's slots, in order.
+         * @param location the location the diagnostic is concerning.
+         */
+        DiagnosticTy<Kind>(const MessageTemplate& message, std::vector<std::string> args, Location location = {}) : Diagnostic(Kind::severity, message, std::move(args), "", "", location) { kindTable = DiagnosticKind::of<Kind>(); }
+
+        /**
+         * Constructs a diagnostic whose message is made from a template, with a submessage and a custom error code.
+         * @param message the message template, must outlive the diagnostic.
+         * @param args the arguments filling the template's slots, in order.
+         * @param subMessage the secondary message which is printed directly next to the source code.
+         * @param code the error code.
+         * @param location the location the diagnostic is concerning.
+         */
+        DiagnosticTy<Kind>(const MessageTemplate& message, std::vector<std::string> args, std::string subMessage, std::string code, Location location) 
+            : Diagnostic(Kind::severity, message, std::move(args), subMessage, code, location) { kindTable = DiagnosticKind::of<Kind>(); }
+
+        /**
+         * Pretty-print the diagnostic.
+         * @param out stream in which to print the error.
+         * @return the object which this function was called upon.
+         */
+        DiagnosticTy<Kind>& print(std::ostream& out, const Config& config)             { Diagnostic::print(out, config); return *this; }
+        DiagnosticTy<Kind>& print(std::ostream& out, const Config&& config = Config()) { Diagnostic::print(out, config); return *this; }
+
+        /**
+         * Adds a secondary note message to the diagnostic at `location`.
+         * @param message the note message.
+         * @param location source code location of the note message.
+         * @return the object which this function was called upon.
+         */
+        DiagnosticTy<Kind>& withNote(std::string message, Location location) { Diagnostic::withNote(message, location); return *this; }
+
+        /**
+         * Adds a secondary help message to the diagnostic at `location`.
+         * @param message the help message.
+         * @param location source code location of the help message.
+         * @return the object which this function was called upon.
+         */
+        DiagnosticTy<Kind>& withHelp(std::string message, Location location) { Diagnostic::withHelp(message, location); return *this; }
+
+        /**
+         * Adds a secondary note message to the diagnostic without a specific location.
+         * @param message the note message.
+         * @return the object which this function was called upon.
+         */
+        DiagnosticTy<Kind>& withNote(std::string message) { Diagnostic::withNote(message); return *this; }
+
+        /**
+         * Adds a secondary help message to the diagnostic without a specific location.
+         * @param message the help message.
+         * @return the object which this function was called upon.
+         */
+        DiagnosticTy<Kind>& withHelp(std::string message) { Diagnostic::withHelp(message); return *this; }
+
+        /**
+         * Adds a secondary note message with styled spans to the diagnostic.
+         * @param message the note message.
+         * @param location source code location of the note message.
+         * @return the object which this function was called upon.
+         */
+        DiagnosticTy<Kind>& withNote(const StyledText& message, Location location = {}) { Diagnostic::withNote(message, location); return *this; }
+
+        /**
+         * Adds a secondary help message with styled spans to the diagnostic.
+         * @param message the help message.
+         * @param location source code location of the help message.
+         * @return the object which this function was called upon.
+         */
+        DiagnosticTy<Kind>& withHelp(const StyledText& message, Location location = {}) { Diagnostic::withHelp(message, location); return *this; }
+
+        /**
+         * Adds a suggested edit to the diagnostic.
+         * @param location source code location to be replaced.
+         * @param replacement the text to replace it with.
+         * @return the object which this function was called upon.
+         */
+        DiagnosticTy<Kind>& withFixIt(Location location, std::string replacement) { Diagnostic::withFixIt(location, replacement); return *this; }
+
+        /**
+         * Adds a secondary message which may be shared with other diagnostics.
+         * @param secondary the secondary message.
+         * @return the object which this function was called upon.
+         */
+        DiagnosticTy<Kind>& withShared(std::shared_ptr<const Diagnostic> secondary) { Diagnostic::withShared(secondary); return *this; }
+
+        /**
+         * Sets the backtrace of the diagnostic.
+         * @param backtraces the storage of the backtrace, must outlive the diagnostic.
+         * @param innermost the innermost frame of the backtrace.
+         * @return the object which this function was called upon.
+         */
+        DiagnosticTy<Kind>& withBacktrace(const Backtraces& backtraces, Backtraces::Frame innermost) { Diagnostic::withBacktrace(backtraces, innermost); return *this; }
+
+        /**
+         * Adds a "did you mean" help message to the diagnostic.
+         * @param candidates the suggested names, best first.
+         * @param location source code location of the help message.
+         * @return the object which this function was called upon.
+         */
+        DiagnosticTy<Kind>& withSuggestions(const std::vector<std::string>& candidates, Location location = {}) { Diagnostic::withSuggestions(candidates, location); return *this; }
+    };
+
+    /////////////////////////////////////////////////////////////////////////
+
+    /**
+     * An `internal error` diagnostic type. 
+     * These should (ideally) never be shown to the client, rather they should be used as a debugging tool for the compiler developer.
+     */
+    typedef DiagnosticTy<BuiltinKind<DiagnosticType::INTERNAL_ERROR>> InternalError;
+
+    /**
+     * An `error` diagnostic type. 
+     * These are usually errors which stop the compilation process from being competed.
+     */
+    typedef DiagnosticTy<BuiltinKind<DiagnosticType::ERROR>> Error;
+
+    /**
+     * A `warning` diagnostic type.
+     * These don't necessarily halt the compilation process, but they hint at a possible error in the programmer's code.
+     */
+    typedef DiagnosticTy<BuiltinKind<DiagnosticType::WARNING>> Warning;
+
+    /**
+     * A `note` diagnostic type.
+     * Should be used to supplement the `Error`/`Warning` diagnostic, and give useful inforation to solve the issue.
+     */
+    typedef DiagnosticTy<BuiltinKind<DiagnosticType::NOTE>> Note;
+
+    /**
+     * A `help` diagnostic type.
+     * Usually used to give useful hints at how to fix an issue.
+     */
+    typedef DiagnosticTy<BuiltinKind<DiagnosticType::HELP>> Help;
+
+    Diagnostic& Diagnostic::withNote(std::string message, Location location) { return with(Note(message, location)); }
+    Diagnostic& Diagnostic::withHelp(std::string message, Location location) { return with(Help(message, location)); }
+    Diagnostic& Diagnostic::withNote(const StyledText& message, Location location) { return with(Note(message, location)); }
+    Diagnostic& Diagnostic::withHelp(const StyledText& message, Location location) { return with(Help(message, location)); }
+
+    /**
+     * Makes an immutable copy of a diagnostic which can be attached to many diagnostics with `withShared`, 
+     * e.g. a "previously defined here" note which is common to thousands of errors.
+     */
+    inline std::shared_ptr<const Diagnostic> share(Diagnostic diag) { return std::make_shared<const Diagnostic>(std::move(diag)); }
+
+    /////////////////////////////////////////////////////////////////////////
+
+    /**
+     * Recycles diagnostic objects, for frontends which create (and mostly filter out) huge numbers of short-lived diagnostics.
+     * A diagnostic made by the pool is returned to it when its handle is destroyed: it is cleared (see `Diagnostic::clear()`)
+     * and kept in the free list of the thread which released it, so the strings and vectors of recycled diagnostics keep
+     * their capacity, and creating diagnostics in a steady state doesn't allocate. Free lists never take a lock.
+     *
+     *     auto diag = reporter::DiagnosticPool::make(reporter::DiagnosticType::WARNING, "unused variable", "", "W101", loc);
+     *     rep.report(*diag); // only copied if it isn't suppressed
+     */
+    class DiagnosticPool {
+    public:
+        /* returns a diagnostic to the free list of the current thread */
+        struct Recycler {
+            void operator()(Diagnostic* diag) const {
+                auto& list = freeList();
+                if (list.size() >= maxFree) {
+                    delete diag;
+                    return;
+                }
+                diag->clear();
+                list.emplace_back(diag);
+            }
+        };
 
-                for (size_t j = 0; j < toRender.size(); j++) {
-                    if (j != 0) {
-                        out << "\n";
-                        printLeft(config, out, maxLine);
-                    }
-                    for (size_t lineIdx = 0; lineIdx < line.size(); lineIdx++) {
-                        int8_t count = 0;
-                        Diagnostic* lastFound = nullptr;
-                        for (auto curr : toRender[j])
-                            if (curr->loc.start <= lineIdx && lineIdx < curr->loc.end) {
-                                count++;
-                                lastFound = curr;
-                            }
-                        if (!lastFound)
-                            for (auto k = j; count == 0 && k > 0; k--) {
-                                for (auto diag : toRender[k-1])
-                                    if (diag->loc.start == lineIdx) {
-                                        count = -1;
-                                        lastFound = diag;
-                                        break;
-                                    }
-                            }
-                        if (lastFound)
-                            lastFound->color(config).print(out, getUnderline(config, count, line, lineIdx));
-                        else out << getUnderline(config, count, line, lineIdx);
-                    }
+        /** A diagnostic borrowed from the pool. */
+        typedef std::unique_ptr<Diagnostic, Recycler> Handle;
+
+        /** The number of free diagnostics kept per thread, diagnostics released beyond it are deleted. */
+        static constexpr size_t maxFree = 4096;
+
+    private:
+        static std::vector<std::unique_ptr<Diagnostic>>& freeList() {
+            static thread_local std::vector<std::unique_ptr<Diagnostic>> list;
+            return list;
+        }
+
+    public:
+        /**
+         * Make a diagnostic, reusing a free one of the current thread if there is one.
+         * @param ty the type of the diagnostic.
+         * @param message the diagnostic message.
+         * @param subMessage the secondary message which is printed directly next to the source code.
+         * @param code the error code.
+         * @param location the location the diagnostic is concerning.
+         */
+        static Handle make(DiagnosticType ty, const char* message, const char* subMessage = "", const char* code = "", Location location = {}) {
+            auto& list = freeList();
+            Diagnostic* diag;
+            if (list.empty())
+                diag = new Diagnostic(ty, "", "", "", {});
+            else {
+                diag = list.back().release();
+                list.pop_back();
+            }
+            diag->errTy = ty;
+            diag->kindTable = DiagnosticKind::of(ty);
+            diag->msg.assign(message);
+            diag->subMsg.assign(subMessage);
+            diag->code.assign(code);
+            diag->loc = location;
+            return Handle(diag);
+        }
+
+        /** @see make(DiagnosticType, const char*, const char*, const char*, Location) */
+        static Handle make(DiagnosticType ty, const std::string& message, const std::string& subMessage = "",
+                           const std::string& code = "", Location location = {}) {
+            return make(ty, message.c_str(), subMessage.c_str(), code.c_str(), location);
+        }
+
+        /** @return the number of free diagnostics of the current thread. */
+        static size_t available() { return freeList().size(); }
+    };
+
+    /////////////////////////////////////////////////////////////////////////
+
+    /**
+     * Sort a batch of diagnostics by file path, line and column, keeping the original order of diagnostics at the same location.
+     * Diagnostics without a location come last.
+     *
+     * Each diagnostic is packed into a 128 bit key of (file rank, line, column, index), which are then sorted with an LSD radix sort,
+     * so `SourceFile::str()` is only called once per distinct file rather than on every comparison.
+     * @param diags the diagnostics to sort.
+     */
+    inline void sortByLocation(std::vector<Diagnostic>& diags) {
+        struct Key { uint64_t hi, lo; }; // hi = file rank << 32 | line, lo = column << 32 | index
+        if (diags.size() < 2) return;
+
+        // rank the files by their path, files with the same path get the same rank
+        std::unordered_map<SourceFile*, uint32_t> ranks;
+        std::vector<std::pair<std::string, SourceFile*>> files;
+        for (auto& diag : diags) {
+            auto file = diag.location().file;
+            if (file && ranks.emplace(file, 0).second)
+                files.push_back({ file->str(), file });
+        }
+        std::sort(files.begin(), files.end());
+        uint32_t rank = 0;
+        for (size_t i = 0; i < files.size(); i++) {
+            if (i && files[i].first != files[i - 1].first)
+                rank++;
+            ranks[files[i].second] = rank;
+        }
+
+        std::vector<Key> keys(diags.size()), tmp(diags.size());
+        for (size_t i = 0; i < diags.size(); i++) {
+            auto& loc = diags[i].location();
+            uint64_t fileRank = loc.file ? ranks[loc.file] : std::numeric_limits<uint32_t>::max();
+            keys[i].hi = fileRank << 32 | loc.line;
+            keys[i].lo = static_cast<uint64_t>(loc.start) << 32 | i;
+        }
+
+        // least significant byte first, the index bytes never need sorting since the keys start out in index order
+        for (size_t pass = 4; pass < 16; pass++) {
+            auto shift = (pass % 8) * 8;
+            auto digit = [&](const Key& k) { return ((pass < 8 ? k.lo : k.hi) >> shift) & 0xFF; };
+
+            size_t counts[256] = { 0 };
+            for (auto& key : keys)
+                counts[digit(key)]++;
+            if (counts[digit(keys.front())] == keys.size())
+                continue; // every key has the same digit, nothing to do in this pass
+
+            size_t offset = 0;
+            for (auto& count : counts) {
+                auto c = count;
+                count = offset;
+                offset += c;
+            }
+            for (auto& key : keys)
+                tmp[counts[digit(key)]++] = key;
+            keys.swap(tmp);
+        }
+
+        std::vector<Diagnostic> sorted;
+        sorted.reserve(diags.size());
+        for (auto& key : keys)
+            sorted.push_back(std::move(diags[key.lo & 0xFFFFFFFF]));
+        diags.swap(sorted);
+    }
+
+    /////////////////////////////////////////////////////////////////////////
+
+    /**
+     * Applies the fix-its of a batch of diagnostics to their source files.
+     * Fix-its are grouped by file (by canonical path, so source files naming the same file on disk share one rewrite) and checked
+     * for overlapping edits, then each file is reread and rewritten in a single pass which copies the untouched parts straight
+     * from its index. Files are rewritten in parallel.
+     */
+    class FixItApplier {
+    private:
+        /* a fix-it converted to offsets in its file */
+        struct Edit {
+            size_t start;
+            size_t end;
+            const FixIt* fix;
+
+            bool operator<(const Edit& other) const {
+                return start != other.start ? start < other.start : end < other.end;
+            }
+        };
+
+        /* the fix-its of one file on disk, which may be reached through several source files */
+        struct Target {
+            std::vector<SourceFile*> sources;
+            std::vector<FixIt> fixes;
+        };
+
+        std::vector<Target> targets; // in order of first appearance
+        std::unordered_map<std::string, size_t> byPath; // canonical path -> index in targets
+        std::unordered_map<SourceFile*, size_t> byFile; // so that each source file's path is resolved once
+        std::vector<FixIt> conflicting;
+        std::mutex mutex;
+
+        /* the path of a file with symbolic links and relative parts resolved, so that two names of the same file compare equal */
+        static std::string canonical(const std::string& path) {
+#ifdef REPORTER_POSIX
+            if (char* resolved = ::realpath(path.c_str(), nullptr)) {
+                std::string result(resolved);
+                std::free(resolved);
+                return result;
+            }
+#endif
+            return path;
+        }
+
+        /* rewrite one file, returns whether it was written successfully */
+        bool rewrite(Target& target) {
+            // the edits are made to the file as it is now, not as it was when a source file first indexed it
+            for (auto source : target.sources)
+                source->reload();
+            auto file = target.sources.front();
+            auto index = file->index();
+            auto& contents = index->contents();
+            std::vector<Edit> edits;
+            for (auto& fix : target.fixes) {
+                auto lineStart = index->offset(fix.loc.line);
+                auto lineEnd = lineStart + index->line(fix.loc.line).size();
+                edits.push_back({ std::min(lineStart + fix.loc.start, lineEnd), std::min(lineStart + fix.loc.end, lineEnd), &fix });
+            }
+            std::stable_sort(edits.begin(), edits.end());
+
+            auto path = file->str();
+            auto tmpPath = path + ".fixit";
+            std::ofstream out(tmpPath, std::ios::binary);
+            size_t pos = 0;
+            for (size_t i = 0; i < edits.size(); i++) {
+                auto& edit = edits[i];
+                if (i && edit.start == edits[i-1].start && edit.end == edits[i-1].end && edit.fix->replacement == edits[i-1].fix->replacement)
+                    continue; // the same fix-it reported twice
+                if (edit.start < pos) {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    conflicting.push_back(*edit.fix);
+                    continue;
+                }
+                out.write(contents.data() + pos, static_cast<std::streamsize>(edit.start - pos));
+                out << edit.fix->replacement;
+                pos = edit.end;
+            }
+            out.write(contents.data() + pos, static_cast<std::streamsize>(contents.size() - pos));
+            out.close();
+#ifdef REPORTER_POSIX
+            // the rewritten file replaces the original, so it takes over its mode (e.g. executable scripts) and, where permitted, its owner
+            struct stat info;
+            if (out && ::stat(path.c_str(), &info) == 0) {
+                if (::chmod(tmpPath.c_str(), info.st_mode & 07777) != 0)
+                    out.setstate(std::ios::failbit);
+                if (::chown(tmpPath.c_str(), info.st_uid, info.st_gid) != 0) {} // only privileged processes may give a file away
+            }
+#endif
+            if (!out || std::rename(tmpPath.c_str(), path.c_str()) != 0) {
+                std::remove(tmpPath.c_str());
+                return false;
+            }
+            for (auto source : target.sources)
+                source->reload();
+            return true;
+        }
+
+    public:
+        /**
+         * Collect the fix-its of a diagnostic.
+         */
+        void add(const Diagnostic& diag) {
+            for (auto& fix : diag.fixIts()) {
+                if (!fix.loc.file) continue;
+                auto known = byFile.find(fix.loc.file);
+                if (known == byFile.end()) {
+                    auto inserted = byPath.emplace(canonical(fix.loc.file->str()), targets.size());
+                    if (inserted.second)
+                        targets.emplace_back();
+                    known = byFile.emplace(fix.loc.file, inserted.first->second).first;
+                    targets[known->second].sources.push_back(fix.loc.file);
                 }
+                targets[known->second].fixes.push_back(fix);
+            }
+        }
 
-                out << "\n";
-                for (; i < secondaries.size() && onSameLine(secondaries[i], first); i++) {
-                    printLeft(config, out, maxLine);
-                    for (size_t j = 0; j < secondaries[i].loc.start; j++) {
-                        bool b = false;
-                        for (size_t idx = i; !b && idx < secondaries.size() && onSameLine(secondaries[idx], first); idx++)
-                            if (secondaries[idx].loc.start == j) {
-                                secondaries[idx].color(config).print(out, toString(config.chars.lineVertical));
-                                if (line[j] == '\t' && tabWidth(config, j) > 1)
-                                    out << std::string(tabWidth(config, j) - 1, ' ');
-                                b = true;
-                            }
-                        if (!b) indent(config, out, line, 1, j);
+        /**
+         * Collect the fix-its of a batch of diagnostics.
+         */
+        void add(const std::vector<Diagnostic>& diags) {
+            for (auto& diag : diags)
+                add(diag);
+        }
+
+        /**
+         * Rewrite every file which has fix-its. Fix-its which overlap an earlier fix-it in the same file are skipped (see `conflicts()`).
+         * Files which are still being rendered must not be rewritten, since their indices are reloaded.
+         * Each file is reread before it is rewritten, so its fix-its must refer to its current contents.
+         * @param threads maximum number of files rewritten at once.
+         * @return the number of files which were rewritten successfully.
+         */
+        size_t apply(unsigned threads = std::thread::hardware_concurrency()) {
+            std::atomic<size_t> next(0), written(0);
+            auto worker = [&]() {
+                for (size_t i = next++; i < targets.size(); i = next++)
+                    if (rewrite(targets[i]))
+                        written++;
+            };
+            std::vector<std::thread> workers;
+            for (unsigned t = 1; t < std::min<size_t>(std::max(threads, 1u), targets.size()); t++)
+                workers.emplace_back(worker);
+            worker();
+            for (auto& w : workers)
+                w.join();
+            targets.clear();
+            byPath.clear();
+            byFile.clear();
+            return written;
+        }
+
+        /** @return the fix-its which were skipped by `apply()` because they overlapped another fix-it. */
+        const std::vector<FixIt>& conflicts() const { return conflicting; }
+    };
+
+    /////////////////////////////////////////////////////////////////////////
+
+    /**
+     * Finds the names closest to a misspelled name, for "did you mean" help messages.
+     * Names are kept in a BK-tree, so a query only computes the edit distance to a small part of the names,
+     * and edit distances are computed with Myers' bit-parallel algorithm (for names of up to 64 characters).
+     */
+    class Suggester {
+    private:
+        struct Node {
+            std::string name;
+            std::vector<std::pair<uint32_t, uint32_t>> children; // distance to the child, index of the child
+        };
+
+        /* `pattern` preprocessed for computing edit distances to it */
+        struct Pattern {
+            const std::string& str;
+            uint64_t peq[256]; // bit i of peq[c] is set if str[i] == c
+
+            Pattern(const std::string& s) : str(s) {
+                std::fill(std::begin(peq), std::end(peq), 0);
+                if (s.size() <= 64)
+                    for (size_t i = 0; i < s.size(); i++)
+                        peq[static_cast<uint8_t>(s[i])] |= 1ULL << i;
+            }
+
+            /* Levenshtein distance between the pattern and `text` */
+            uint32_t distance(const std::string& text) const {
+                auto m = str.size();
+                if (m == 0) return static_cast<uint32_t>(text.size());
+                if (m > 64) return distanceSlow(str, text);
+
+                uint64_t pv = ~0ULL, mv = 0;
+                uint64_t last = 1ULL << (m - 1);
+                auto score = static_cast<uint32_t>(m);
+                for (auto c : text) {
+                    uint64_t eq = peq[static_cast<uint8_t>(c)];
+                    uint64_t xv = eq | mv;
+                    uint64_t xh = (((eq & pv) + pv) ^ pv) | eq;
+                    uint64_t ph = mv | ~(xh | pv);
+                    uint64_t mh = pv & xh;
+                    if (ph & last) score++;
+                    else if (mh & last) score--;
+                    ph = (ph << 1) | 1;
+                    mh <<= 1;
+                    pv = mh | ~(xv | ph);
+                    mv = ph & xv;
+                }
+                return score;
+            }
+        };
+
+        std::vector<Node> nodes;
+
+        /* plain dynamic programming edit distance, for names longer than 64 characters */
+        static uint32_t distanceSlow(const std::string& a, const std::string& b) {
+            std::vector<uint32_t> row(b.size() + 1);
+            for (size_t j = 0; j <= b.size(); j++)
+                row[j] = static_cast<uint32_t>(j);
+            for (size_t i = 1; i <= a.size(); i++) {
+                uint32_t diag = row[0];
+                row[0] = static_cast<uint32_t>(i);
+                for (size_t j = 1; j <= b.size(); j++) {
+                    uint32_t up = row[j];
+                    row[j] = std::min(std::min(row[j] + 1, row[j - 1] + 1), diag + (a[i - 1] != b[j - 1]));
+                    diag = up;
+                }
+            }
+            return row[b.size()];
+        }
+
+    public:
+        /**
+         * @return the Levenshtein distance between two strings (in bytes).
+         */
+        static uint32_t distance(const std::string& a, const std::string& b) {
+            return Pattern(a).distance(b);
+        }
+
+        /**
+         * Add a name which can be suggested.
+         */
+        void add(const std::string& name) {
+            if (nodes.empty()) {
+                nodes.push_back({ name, {} });
+                return;
+            }
+            Pattern pattern(name);
+            size_t curr = 0;
+            while (true) {
+                auto dist = pattern.distance(nodes[curr].name);
+                if (dist == 0) return; // already added
+                bool found = false;
+                for (auto& child : nodes[curr].children)
+                    if (child.first == dist) {
+                        curr = child.second;
+                        found = true;
+                        break;
                     }
-                    auto lines = splitLines(secondaries[i].msg);
+                if (!found) {
+                    nodes[curr].children.push_back({ dist, static_cast<uint32_t>(nodes.size()) });
+                    nodes.push_back({ name, {} });
+                    return;
+                }
+            }
+        }
+
+        /**
+         * Find the names closest to `name`.
+         * @param name the misspelled name.
+         * @param maxDistance maximum edit distance of a suggestion from `name`.
+         * @param maxResults maximum number of suggestions.
+         * @return the suggestions, closest first (names at the same distance are ordered alphabetically).
+         */
+        std::vector<std::string> suggest(const std::string& name, uint32_t maxDistance, size_t maxResults = 3) const {
+            std::vector<std::pair<uint32_t, const std::string*>> found;
+            if (!nodes.empty()) {
+                Pattern pattern(name);
+                std::vector<uint32_t> stack = { 0 };
+                while (!stack.empty()) {
+                    auto& node = nodes[stack.back()];
+                    stack.pop_back();
+                    auto dist = pattern.distance(node.name);
+                    if (dist <= maxDistance && dist != 0)
+                        found.push_back({ dist, &node.name });
+                    // by the triangle inequality, only children at distance `dist ± maxDistance` can be close enough
+                    for (auto& child : node.children)
+                        if (child.first + maxDistance >= dist && child.first <= dist + maxDistance)
+                            stack.push_back(child.second);
+                }
+            }
+            std::sort(found.begin(), found.end(), [](const std::pair<uint32_t, const std::string*>& a, const std::pair<uint32_t, const std::string*>& b) {
+                return a.first != b.first ? a.first < b.first : *a.second < *b.second;
+            });
+            std::vector<std::string> ret;
+            for (size_t i = 0; i < found.size() && i < maxResults; i++)
+                ret.push_back(*found[i].second);
+            return ret;
+        }
+
+        /**
+         * Find the names closest to `name`, allowing one edit per three characters of `name`.
+         */
+        std::vector<std::string> suggest(const std::string& name) const {
+            return suggest(name, std::max<uint32_t>(1, static_cast<uint32_t>(name.size() / 3)));
+        }
+
+        /** @return number of names which can be suggested. */
+        size_t size() const { return nodes.size(); }
+    };
+
+    /////////////////////////////////////////////////////////////////////////
+
+    /**
+     * Counts the diagnostics of a run, by type and by error code, so a summary can be printed at the end of the run:
+     *
+     *     3 errors, 120 warnings (E308 ×40, W101 ×80) emitted; 1,200 suppressed; 15 dropped
+     *
+     * Every counter is lock-free. Per-type counters are atomics, and each error code is interned once into an atomic counter of its own,
+     * kept in open addressing tables which are only ever added to: a slot is claimed with a compare-and-swap, and a table which is
+     * crowded chains to a twice larger one. Counting a code which was seen before only hashes it and increments its counter.
+     */
+    class Statistics {
+    private:
+        static const size_t typeCount = static_cast<size_t>(DiagnosticType::UNKNOWN) + 1;
+        static const size_t maxProbes = 8;
+
+        /* the counter of an error code, never moved or freed before the statistics */
+        struct CodeCount {
+            const std::string code;
+            std::atomic<size_t> count;
+
+            CodeCount(const std::string& c) : code(c), count(0) {}
+        };
+
+        struct CodeTable {
+            const size_t size; // a power of two
+            std::unique_ptr<std::atomic<CodeCount*>[]> slots;
+            std::atomic<CodeTable*> next; // where codes go once their probe sequence is full
 
-                    for (size_t idx = 0; idx < lines.size(); idx++) {
-                        if (idx == 0) {
-                            secondaries[i].color(config).print(out, config.chars.lineBottomLeft + lines[idx]);
-                            out << "\n";
-                        } else {
-                            printLeft(config, out, maxLine);
-                            for (size_t j = 0; j < secondaries[i].loc.start; j++) {
-                                bool b = false;
-                                for (auto k = i; !b && k < secondaries.size() && onSameLine(secondaries[k], first); k++)
-                                    if (secondaries[k].loc.start == j) {
-                                        secondaries[k].color(config).print(out, toString(config.chars.lineVertical));
-                                        if (line[j] == '\t' && tabWidth(config, j) > 1)
-                                            out << std::string(tabWidth(config, j) - 1, ' ');
-                                        b = true;
-                                    }
-                                
-                                if (!b) indent(config, out, line, 1, j);
-                            }
-                            secondaries[i].color(config).print(out, std::string(countChars(config.chars.lineBottomLeft), ' ') + lines[idx]);
-                            out << "\n";
-                        }
-                    }
+            CodeTable(size_t n) : size(n), slots(new std::atomic<CodeCount*>[n]), next(nullptr) {
+                for (size_t i = 0; i < n; i++)
+                    slots[i].store(nullptr, std::memory_order_relaxed);
+            }
 
-                    for (auto& sec : secondaries[i].secondaries) {
-                        lines = splitLines(sec.msg);
+            ~CodeTable() {
+                for (size_t i = 0; i < size; i++)
+                    delete slots[i].load(std::memory_order_relaxed);
+                delete next.load(std::memory_order_relaxed);
+            }
+        };
 
-                        for (size_t idx = 0; idx < lines.size(); idx++) {
-                            if (secondaries[i].msg == "" && idx == 0) {
-                                secondaries[i].color(config).print(out, config.chars.lineBottomLeft);
-                                sec.color(config).print(out, lines[idx]);
-                                out << "\n";
-                            } else {
-                                printLeft(config, out, maxLine);
-                                for (size_t j = 0; j < sec.loc.start; j++) {
-                                    bool b = false;
-                                    for (auto k = i; !b && k < secondaries.size() && onSameLine(secondaries[k], first); k++)
-                                        if (secondaries[k].loc.start == j) {
-                                            secondaries[k].color(config).print(out, toString(config.chars.lineVertical));
-                                            if (line[j] == '\t' && tabWidth(config, j) > 1)
-                                                out << std::string(tabWidth(config, j) - 1, ' ');
-                                            b = true;
-                                        }
-                                    
-                                    if (!b) indent(config, out, line, 1, j);
-                                }
-                                sec.color(config).print(out, std::string(countChars(config.chars.lineBottomLeft), ' ') + lines[idx]);
-                                out << "\n";
-                            }
-                        }
+        std::atomic<size_t> types[typeCount];
+        std::atomic<size_t> suppressedCount;
+        std::atomic<size_t> droppedCount;
+        CodeTable codeTable;
+
+        /* the counter of `code`, interned on first use */
+        std::atomic<size_t>& counter(const std::string& code) {
+            auto h = std::hash<std::string>()(code);
+            for (auto table = &codeTable;;) {
+                auto mask = table->size - 1;
+                for (size_t probe = 0, i = h & mask; probe < maxProbes; probe++, i = (i + 1) & mask) {
+                    auto slot = table->slots[i].load(std::memory_order_acquire);
+                    if (!slot) {
+                        auto fresh = new CodeCount(code);
+                        if (table->slots[i].compare_exchange_strong(slot, fresh, std::memory_order_acq_rel))
+                            return fresh->count;
+                        delete fresh; // another thread claimed the slot first, `slot` is now its code
                     }
+                    if (slot->code == code)
+                        return slot->count;
                 }
+                auto next = table->next.load(std::memory_order_acquire);
+                if (!next) {
+                    auto fresh = new CodeTable(table->size * 2);
+                    if (table->next.compare_exchange_strong(next, fresh, std::memory_order_acq_rel))
+                        next = fresh;
+                    else delete fresh;
+                }
+                table = next;
             }
         }
 
-    protected:
-        Diagnostic(DiagnosticType ty, std::string message, std::string subMessage, std::string diagCode, Location location) 
-               : msg(message), subMsg(subMessage), loc(location), errTy(ty), code(diagCode) {}
-        Diagnostic(DiagnosticType ty, std::string message, std::string subMessage, Location location) : Diagnostic(ty, message, subMessage, "", location) {}
-        Diagnostic(DiagnosticType ty, std::string message, Location location) : Diagnostic(ty, message, "", location) {}
-        Diagnostic(DiagnosticType ty, std::string message) : Diagnostic(ty, message, {}) {}
-
     public:
+        Statistics() : suppressedCount(0), droppedCount(0), codeTable(64) {
+            for (auto& count : types)
+                count = 0;
+        }
+
+        /* format a number with thousands separators, e.g. 4997 -> "4,997" */
+        static std::string formatCount(size_t count) {
+            std::string str = std::to_string(count);
+            for (size_t i = str.size(); i > 3; i -= 3)
+                str.insert(i - 3, ",");
+            return str;
+        }
+
         /**
-         * Pretty-print the diagnostic.
-         * @param out stream in which to print the error.
-         * @return the object which this function was called upon.
+         * Count an emitted diagnostic.
          */
-        Diagnostic& print(std::ostream& out, const Config& config) {
+        void count(const Diagnostic& diag) {
+            types[static_cast<size_t>(diag.type())].fetch_add(1, std::memory_order_relaxed);
+            if (diag.errorCode() != "")
+                counter(diag.errorCode()).fetch_add(1, std::memory_order_relaxed);
+        }
 
-            // sort the vector of secondary messages based on the order we want to be printing them 
-            sortSecondaries();
+        /**
+         * Count diagnostics which were filtered out before being emitted.
+         */
+        void suppress(size_t count = 1) {
+            suppressedCount.fetch_add(count, std::memory_order_relaxed);
+        }
 
-            if (config.style == DisplayStyle::SHORT) {
-                if (loc.file)
-                    out << loc.file->str() << ":" << loc.line << ":" << loc.start << ":" << loc.end << ": ";
-                color(config).print(out, tyToString(config) + ": ");
-                maybeInherit(config, config.colors.message).print(out, replaceAll(msg, "\n", config.chars.shortModeLineSeperator));
-                out << "\n";
-                for (auto& i : secondaries)
-                {
-                    if (i.loc.file) 
-                        out << i.loc.file->str() << ":" << i.loc.line << ":" << i.loc.start << ":" << i.loc.end << ": ";
-                    i.color(config).print(out, i.tyToString(config) + ": ");
-                    out << replaceAll(i.msg, "\n", config.chars.shortModeLineSeperator) << "\n";
-                }
-                return *this;
-            }
+        /**
+         * Count diagnostics which were reported, but dropped before being emitted (for example by an `AsyncWriter` under backpressure).
+         */
+        void drop(size_t count = 1) {
+            droppedCount.fetch_add(count, std::memory_order_relaxed);
+        }
 
-            // find the maximum line (to know by how much to indent the bars)
-            auto maxLine = loc.line;
-            for (auto& secondary : secondaries)
-                if (secondary.loc.line > maxLine)
-                    maxLine = secondary.loc.line;
+        /** @return number of emitted diagnostics of type `ty`. */
+        size_t emitted(DiagnosticType ty) const {
+            return types[static_cast<size_t>(ty)].load(std::memory_order_relaxed);
+        }
 
-            // by default we're pointing at the error location from below the code snippet
-            bool printAbove = false; 
+        /** @return number of diagnostics which were filtered out. */
+        size_t suppressed() const {
+            return suppressedCount.load(std::memory_order_relaxed);
+        }
 
-            // if there are any messages on the line of the error, point to the error from above instead
-            for (auto& i : secondaries)
-                if (onSameLine(i, *this) && i.loc != loc) {
-                    printAbove = true;
-                    break;
-                }
+        /** @return number of diagnostics which were dropped. */
+        size_t dropped() const {
+            return droppedCount.load(std::memory_order_relaxed);
+        }
 
-            // print the main error message
-            if (msg != "") {
-                color(config).print(out, tyToString(config) + ": ");
-                maybeInherit(config, config.colors.message).print(out, msg);
-                out << "\n";
-            }
+        /** @return number of emitted diagnostics per error code, sorted by code. */
+        std::vector<std::pair<std::string, size_t>> codes() {
+            std::vector<std::pair<std::string, size_t>> ret;
+            for (auto table = &codeTable; table; table = table->next.load(std::memory_order_acquire))
+                for (size_t i = 0; i < table->size; i++)
+                    if (auto slot = table->slots[i].load(std::memory_order_acquire))
+                        ret.push_back({ slot->code, slot->count.load(std::memory_order_relaxed) });
+            std::sort(ret.begin(), ret.end());
+            return ret;
+        }
 
-            size_t i = 0; // current index in `secondaries`
-            uint32_t lastLine = 0; // the last line we rendered
-            std::string line = ""; // the snippet we're going to print
+        /**
+         * Print a one line summary of the run.
+         * @param out stream in which to print the summary.
+         */
+        void print(std::ostream& out) {
+            static const DiagnosticType order[] = {
+                DiagnosticType::INTERNAL_ERROR, DiagnosticType::ERROR, DiagnosticType::WARNING, DiagnosticType::NOTE, DiagnosticType::HELP
+            };
+            static const char* names[] = { "internal error", "error", "warning", "note", "help message" };
 
-            // skip to after the diagnostic's location is printed if it has no location 
-            if (loc.file == nullptr) goto afterSubMsg;
+            std::string str;
+            for (size_t i = 0; i < sizeof(order) / sizeof(*order); i++) {
+                auto count = emitted(order[i]) + (order[i] == DiagnosticType::INTERNAL_ERROR ? emitted(DiagnosticType::UNKNOWN) : 0);
+                if (count)
+                    str += (str == "" ? "" : ", ") + formatCount(count) + " " + names[i] + (count == 1 ? "" : "s");
+            }
+            if (str == "")
+                str = "no diagnostics";
+
+            auto perCode = codes();
+            for (size_t i = 0; i < perCode.size(); i++)
+                str += (i ? ", " : " (") + perCode[i].first + " ×" + formatCount(perCode[i].second) + (i + 1 == perCode.size() ? ")" : "");
+
+            out << str << " emitted";
+            if (suppressed())
+                out << "; " << formatCount(suppressed()) << " suppressed";
+            if (dropped())
+                out << "; " << formatCount(dropped()) << " dropped";
+            out << "\n";
+        }
+    };
 
-            // print the file the error is in
-            printTop(config, out, loc.file, maxLine);
+    /////////////////////////////////////////////////////////////////////////
 
-            // top padding
-            for (uint8_t idx = 0; idx < config.padding.borderTop - 1; idx++) {
-                printLeft(config, out, maxLine);
-                out << "\n";
+    /**
+     * A set of known diagnostics, so that only new diagnostics fail a build when adopting a new lint.
+     *
+     * Diagnostics are identified by a fingerprint of their code, their normalized message, and the source text around their location -
+     * but not their line number, so fingerprints survive unrelated edits which shift lines around.
+     * The set is an open addressing hash table which is saved to disk as is, so loading it involves no parsing, and lookups are O(1).
+     */
+    class Baseline {
+    private:
+        static constexpr const char* magic = "RPBL";
+        static const uint32_t formatVersion = 1;
+
+        std::vector<uint64_t> slots; // 0 marks an empty slot, size is always a power of two
+        size_t count = 0;
+
+        /* polynomial rolling hash, skipping whitespace */
+        static uint64_t hashText(uint64_t h, const char* data, size_t size) {
+            for (size_t i = 0; i < size; i++)
+                if (!std::isspace(static_cast<unsigned char>(data[i])))
+                    h = h * 1099511628211ULL + static_cast<unsigned char>(data[i]) + 1;
+            return h * 1099511628211ULL + 1; // separator
+        }
+
+        /* hash of the message with runs of whitespace collapsed and numbers replaced, so "expected 3 arguments" matches "expected 4 arguments" */
+        static uint64_t hashMessage(uint64_t h, const std::string& msg) {
+            std::string normalized;
+            for (size_t i = 0; i < msg.size(); i++) {
+                if (std::isdigit(static_cast<unsigned char>(msg[i]))) {
+                    while (i + 1 < msg.size() && std::isdigit(static_cast<unsigned char>(msg[i + 1]))) i++;
+                    normalized += '0';
+                } else if (!std::isspace(static_cast<unsigned char>(msg[i])))
+                    normalized += msg[i];
             }
+            return hashText(h, normalized.data(), normalized.size());
+        }
 
-            // first print all messages in the main file which come before the error
-            while (i < secondaries.size() && secondaries[i].loc.file == loc.file && secondaries[i].loc.line < loc.line) {
-                auto &secondary = secondaries[i];
+        size_t find(uint64_t fingerprint) const {
+            size_t mask = slots.size() - 1;
+            size_t i = static_cast<size_t>(fingerprint * 0x9E3779B97F4A7C15ULL >> 17) & mask;
+            while (slots[i] != 0 && slots[i] != fingerprint)
+                i = (i + 1) & mask;
+            return i;
+        }
 
-                if (lastLine == 0 && config.padding.borderTop != 0) { // if we're rendering the first line in the file, print an empty line
-                    printLeft(config, out, maxLine); 
-                    out << "\n";
-                } else if (lastLine != 0 && lastLine < secondary.loc.line - 1)
-                    printPadding(config, out, maxLine, lastLine, secondary.loc.line, secondary.loc.file);
+        void grow() {
+            std::vector<uint64_t> old(std::max<size_t>(slots.size() * 2, 64), 0);
+            old.swap(slots);
+            for (auto fingerprint : old)
+                if (fingerprint)
+                    slots[find(fingerprint)] = fingerprint;
+        }
 
-                lastLine = secondary.loc.line;
-                line = loc.file->getLine(secondary.loc.line);
-                printLeftWithLineNum(config, out, secondary.loc.line, maxLine);
-                printLine(config, out, line);
-                printSecondariesOnLine(config, out, line, i, maxLine, printAbove);
+    public:
+        /** Number of lines above and below a diagnostic's line which are part of its fingerprint. */
+        static const uint32_t contextLines = 1;
+
+        /**
+         * Compute the fingerprint of a diagnostic.
+         * Reads the source text around the diagnostic from its file's index, that is from `SourceFile::read()`.
+         */
+        static uint64_t fingerprint(const Diagnostic& diag) {
+            uint64_t h = 14695981039346656037ULL;
+            h = hashText(h, diag.errorCode().data(), diag.errorCode().size());
+            h = hashMessage(h, diag.message());
+            auto& loc = diag.location();
+            if (loc.file) {
+                auto path = loc.file->str();
+                h = hashText(h, path.data(), path.size());
+                auto index = loc.file->index();
+                size_t size = 0;
+                for (uint32_t line = loc.line > contextLines ? loc.line - contextLines : 1; line <= loc.line + contextLines; line++)
+                    if (auto data = index->line(line, size))
+                        h = hashText(h, data, size);
+                if (auto data = index->line(loc.line, size))
+                    if (loc.start < size)
+                        h = hashText(h, data + loc.start, std::min<size_t>(loc.end, size) - loc.start);
             }
+            return h ? h : 1;
+        }
 
-            line = loc.file->getLine(loc.line);
+        /** Add a fingerprint to the baseline. */
+        void add(uint64_t fingerprint) {
+            if (fingerprint == 0) fingerprint = 1;
+            if ((count + 1) * 2 > slots.size())
+                grow();
+            auto& slot = slots[find(fingerprint)];
+            if (slot == 0) {
+                slot = fingerprint;
+                count++;
+            }
+        }
 
-            if (lastLine == 0 && !printAbove && config.padding.borderTop != 0) {
-                printLeft(config, out, maxLine);
-                out << "\n";
-            } else if (lastLine != 0 && lastLine < loc.line - 1)
-                printPadding(config, out, maxLine, lastLine, loc.line, loc.file);
-            lastLine = loc.line;
-            
-            if (printAbove) {
-                if (subMsg != "") {
-                    for (auto currLine : splitLines(subMsg)) {
-                        printLeft(config, out, maxLine);
-                        indent(config, out, line, loc.start);
-                        color(config).print(out, currLine);
-                        out << "\n";
-                    }
-                }
-                
-                printLeft(config, out, maxLine);
+        /** Add a diagnostic to the baseline. */
+        void add(const Diagnostic& diag) { add(fingerprint(diag)); }
 
-                indent(config, out, line, loc.start);
-                for (auto j = loc.start; j < loc.end; j++)
-                    if (line[j] == '\t')
-                        color(config).print(out, repeat(toString(config.chars.arrowDown), tabWidth(config, j)));
-                    else color(config).print(out, toString(config.chars.arrowDown));
-                out << "\n";
+        /** @return whether the baseline contains the fingerprint. */
+        bool contains(uint64_t fingerprint) const {
+            if (fingerprint == 0) fingerprint = 1;
+            return count != 0 && slots[find(fingerprint)] == fingerprint;
+        }
+
+        /** @return whether the baseline contains the diagnostic. */
+        bool contains(const Diagnostic& diag) const { return count != 0 && contains(fingerprint(diag)); }
+
+        /** @return number of fingerprints in the baseline. */
+        size_t size() const { return count; }
+
+        /**
+         * Write the baseline to a file. The file uses the machine's byte order.
+         * @return whether the file was written successfully.
+         */
+        bool save(const std::string& path) const {
+            std::ofstream file(path, std::ios::binary);
+            uint32_t version = formatVersion;
+            uint64_t header[2] = { count, slots.size() };
+            file.write(magic, 4);
+            file.write(reinterpret_cast<const char*>(&version), sizeof(version));
+            file.write(reinterpret_cast<const char*>(header), sizeof(header));
+            file.write(reinterpret_cast<const char*>(slots.data()), static_cast<std::streamsize>(slots.size() * sizeof(uint64_t)));
+            return static_cast<bool>(file);
+        }
+
+        /**
+         * Replace the baseline with one read from a file written by `save()`.
+         * @return whether the file was read successfully, if not the baseline is left empty.
+         */
+        bool load(const std::string& path) {
+            slots.clear();
+            count = 0;
+            std::ifstream file(path, std::ios::binary);
+            char m[4];
+            uint32_t version = 0;
+            uint64_t header[2] = { 0, 0 };
+            file.read(m, 4);
+            file.read(reinterpret_cast<char*>(&version), sizeof(version));
+            file.read(reinterpret_cast<char*>(header), sizeof(header));
+            if (!file || std::string(m, 4) != magic || version != formatVersion)
+                return false;
+            // the table must be exactly the rest of the file, so a corrupt header can't make us allocate more than the file's size
+            auto tableStart = file.tellg();
+            file.seekg(0, std::ios::end);
+            auto tableSize = static_cast<uint64_t>(file.tellg() - tableStart);
+            file.seekg(tableStart);
+            if (header[1] == 0 || header[1] & (header[1] - 1) || tableSize % sizeof(uint64_t) || tableSize / sizeof(uint64_t) != header[1])
+                return false;
+            std::vector<uint64_t> table(static_cast<size_t>(header[1]));
+            file.read(reinterpret_cast<char*>(table.data()), static_cast<std::streamsize>(table.size() * sizeof(uint64_t)));
+            if (!file)
+                return false;
+            // lookups only end at an empty slot, so the table must have one, and the count must match the table
+            auto used = static_cast<uint64_t>(table.size() - std::count(table.begin(), table.end(), 0));
+            if (used != header[0] || used >= header[1])
+                return false;
+            slots.swap(table);
+            count = static_cast<size_t>(header[0]);
+            return true;
+        }
+    };
+
+    /////////////////////////////////////////////////////////////////////////
+
+    /**
+     * Prints a stream of diagnostics, as they arrive, to a single output stream.
+     * Diagnostics which share a kind, an error code and a message are grouped together - after the first
+     * `config.limits.similar` of a group are printed, the rest are only counted, and are summarized by `flush()`:
+     *
+     *     Error(E308): and 4,997 more in foo.dn at lines 12, 40, 77, ...
+     *
+     * Collapsed diagnostics are never sorted or laid out. Their source files are only read to check them against a baseline,
+     * or against allow comments if they have an error code (see below) - every reported diagnostic is checked before it's grouped.
+     *
+     * Diagnostics which are in a `Baseline` passed to `suppress()`, or which are allowed by a `reporter: allow(CODE)` comment
+     * on their line or on the line above it, are counted as suppressed and never rendered.
+     *
+     * If `config.limits.errors` is set, errors are not printed as they arrive - only the earliest errors by location
+     * are kept (in a bounded heap), and they are printed in order by `flush()`. Errors printed by a flush are taken from the budget of later flushes.
+     *
+     * Once a deadline is set by `setDeadline()`, a diagnostic which would probably not finish rendering in RICH style
+     * before the deadline is printed in SHORT style instead, as is every diagnostic after it until the next deadline.
+     * The estimate is a running average of earlier RICH renders, kept separately for renders which had to read a file.
+     * Degraded diagnostics are kept, so that they can be rendered in full later on, see `takeDegraded()`.
+     *
+     * In ordered mode (see `order()`) the output doesn't depend on the order diagnostics arrive in: diagnostics are printed
+     * by file path, line and column. Rather than holding everything until the end, producers report per-file watermarks
+     * with `complete()`, and every diagnostic which no later arrival can precede is printed right away.
+     * All member functions are thread safe.
+     */
+    class Reporter {
+    public:
+        typedef std::chrono::steady_clock Clock;
+
+    private:
+        /* a set of diagnostics which share a kind, a code and a message */
+        struct Group {
+            const DiagnosticKind* kind; // with `code`, all the summary needs from the group's diagnostics
+            std::string code;
+            size_t shown;       // number of diagnostics which were printed in full
+            size_t collapsed;   // number of diagnostics which were only counted
+            std::vector<std::pair<SourceFile*, std::vector<uint32_t>>> lines; // lines of the collapsed diagnostics, by file
+
+            Group(const Diagnostic& diag) : kind(diag.kindTable), code(diag.code), shown(0), collapsed(0) {}
+        };
+
+        /* an error held back by `config.limits.errors`, ordered by file path, line and start column, then by arrival */
+        struct Held {
+            Diagnostic diag;
+            std::string path; // cached so comparisons don't call `SourceFile::str()`
+            uint64_t seq;     // order of arrival, breaks ties between identical locations
+
+            Held(Diagnostic d, uint64_t sequence) : diag(std::move(d)), path(diag.loc.file ? diag.loc.file->str() : ""), seq(sequence) {}
+
+            bool operator<(const Held& other) const {
+                auto& a = diag.loc;
+                auto& b = other.diag.loc;
+                if (!a.file != !b.file)
+                    return b.file == nullptr;
+                if (path != other.path)
+                    return path < other.path;
+                if (a.line != b.line)
+                    return a.line < b.line;
+                if (a.start != b.start)
+                    return a.start < b.start;
+                return seq < other.seq;
             }
-            
-            printLeftWithLineNum(config, out, loc.line, maxLine);
-            printLine(config, out, line);
+        };
 
-            if (!printAbove) {
-                printLeft(config, out, maxLine);
-                indent(config, out, line, loc.start);
-                for (auto j = loc.start; j < loc.end; j++)
-                    if (line[j] == '\t')
-                        color(config).print(out, repeat(toString(config.chars.arrowUp), tabWidth(config, j)));
-                    else color(config).print(out, toString(config.chars.arrowUp));
-                if (subMsg == "")
-                    out << "\n";
-                else {
-                    auto split = splitLines(subMsg);
-                    for (size_t k = 0; k < split.size(); k++) {
-                        if (k) {
-                            printLeft(config, out, maxLine);
-                            indent(config, out, line, loc.end);
-                        }
-                        out << " ";
-                        color(config).print(out, split[k]);
-                        out << "\n";
-                    }
+        std::ostream& out;
+        Config config;
+        std::mutex mutex;
+        std::unordered_map<std::string, size_t> groupIndices; // maps a group's key to its index in `groups`
+        std::vector<Group> groups; // in order of first appearance
+        std::vector<Held> held;    // max-heap of the earliest errors, the latest of them on top
+        size_t heldPrinted = 0;    // number of held errors printed by earlier flushes
+        uint64_t sequence = 0;
+        Statistics stats;
+        const Baseline* baseline = nullptr;
+
+        Clock::time_point deadline = Clock::time_point::max();
+        bool degrading = false; // set once a render would miss the deadline, until the next deadline is set
+        Clock::duration richCost = Clock::duration::zero(); // running average of RICH renders which didn't read any file
+        Clock::duration loadCost = Clock::duration::zero(); // running average of RICH renders which read a file
+        std::vector<Diagnostic> degraded;
+
+        /* a diagnostic waiting in ordered mode, ordered by its location, and by its hash between identical locations */
+        struct Waiting {
+            Diagnostic diag;
+            uint64_t hash;
+
+            Waiting(Diagnostic d) : diag(std::move(d)), hash(diag.hash()) {}
+
+            bool operator>(const Waiting& other) const {
+                auto& a = diag.loc;
+                auto& b = other.diag.loc;
+                if (a.line != b.line)
+                    return a.line > b.line;
+                if (a.start != b.start)
+                    return a.start > b.start;
+                if (a.end != b.end)
+                    return a.end > b.end;
+                return hash > other.hash;
+            }
+        };
+
+        /* a file of ordered mode, diagnostics before its watermark can be printed once every earlier file is complete */
+        struct OrderedFile {
+            SourceFile* file;
+            std::string path;
+            uint32_t watermark;           // no more diagnostics will arrive before this line
+            std::vector<Waiting> waiting; // min-heap
+        };
+
+        bool ordered = false;
+        std::vector<OrderedFile> orderedFiles;                 // by path
+        std::unordered_map<SourceFile*, size_t> orderedIndices; // maps a file to its index in `orderedFiles`
+        size_t orderedNext = 0;                                 // the first file which isn't complete
+        std::vector<Waiting> unordered; // diagnostics of other files, or without a file, printed by `flush()`
+
+        /* the key diagnostics are grouped by */
+        static std::string groupKey(const Diagnostic& diag) {
+            auto key = diag.kindTable->key + '\0' + diag.code;
+            if (diag.tmpl) // messages made from the same template are similar, whatever their arguments
+                return key + '\1' + std::string(reinterpret_cast<const char*>(&diag.tmpl), sizeof(diag.tmpl));
+            return key + '\0' + diag.msg;
+        }
+
+        /* remember a collapsed diagnostic's location */
+        static void collapse(Group& group, const Location& loc) {
+            group.collapsed++;
+            if (!loc.file) return;
+            for (auto it = group.lines.rbegin(); it != group.lines.rend(); it++)
+                if (it->first == loc.file) {
+                    it->second.push_back(loc.line);
+                    return;
                 }
-                for (size_t j = i; j < secondaries.size() && secondaries[j].loc.file == loc.file && secondaries[j].loc.line == loc.line; j++) {
-                    if (secondaries[j].loc == loc) {
-                        for (auto str : splitLines(secondaries[j].msg)) {
-                            printLeft(config, out, maxLine);
-                            indent(config, out, line, loc.end);
-                            out << " ";
-                            secondaries[j].color(config).print(out, str);
-                            out << "\n";
-                        }
+            group.lines.push_back({ loc.file, { loc.line } });
+        }
+
+        /* prints the "and N more" line(s) of a group */
+        void printCollapsed(Group& group) {
+            auto header = Diagnostic::tyToString(config, *group.kind, group.code) + ": ";
+            auto color = group.kind->color(config);
+            size_t withoutFile = group.collapsed;
+            for (auto& file : group.lines) {
+                auto& lines = file.second;
+                auto count = lines.size(); // several diagnostics may share a line, count them before listing each line once
+                withoutFile -= count;
+                std::sort(lines.begin(), lines.end());
+                lines.erase(std::unique(lines.begin(), lines.end()), lines.end());
+
+                color.print(out, header);
+                out << "and " << Statistics::formatCount(count) << " more in " << file.first->str() << " at line" << (lines.size() > 1 ? "s " : " ");
+                for (size_t i = 0; i < lines.size(); i++) {
+                    if (config.limits.summaryLines && i == config.limits.summaryLines) {
+                        out << ", ...";
+                        break;
                     }
+                    out << (i ? ", " : "") << lines[i];
                 }
+                out << "\n";
             }
-        
-            if (i < secondaries.size() && onSameLine(secondaries[i], *this))
-                printSecondariesOnLine(config, out, line, i, maxLine, printAbove);
+            if (withoutFile) {
+                color.print(out, header);
+                out << "and " << Statistics::formatCount(withoutFile) << " more\n";
+            }
+        }
 
-        afterSubMsg:    
-            auto currFile = loc.file;
-            while (i < secondaries.size() && secondaries[i].loc.file) {
-                auto &secondary = secondaries[i];
-                if (currFile == nullptr || secondary.loc.file->str() != currFile->str()) {
-                    if (currFile != nullptr)                    
-                        printBottom(config, out, maxLine);
-                    currFile = secondary.loc.file;
-                    printTop(config, out, currFile, maxLine);
-                    for (uint8_t k = 0; k < config.padding.borderTop; k++) {
-                        printLeft(config, out, maxLine);
-                        out << "\n";
-                    }
-                } else if (lastLine < secondary.loc.line - 1)
-                    printPadding(config, out, maxLine, lastLine, secondary.loc.line, secondary.loc.file);
+        /* count a diagnostic in its group, returns whether it is collapsed - then only its location is kept */
+        bool collapsed(const Diagnostic& diag) {
+            auto key = groupKey(diag);
+            auto found = groupIndices.find(key);
+            if (found == groupIndices.end()) {
+                found = groupIndices.emplace(std::move(key), groups.size()).first;
+                groups.emplace_back(diag);
+            }
+            auto& group = groups[found->second];
+            if (config.limits.similar && group.shown >= config.limits.similar) {
+                collapse(group, diag.loc);
+                return true;
+            }
+            group.shown++;
+            return false;
+        }
+
+        /* print a diagnostic, or collapse it if enough similar diagnostics were already printed */
+        void emit(Diagnostic& diag) {
+            if (!collapsed(diag))
+                render(diag);
+        }
+
+        /* whether rendering a diagnostic in RICH style would read a file which wasn't read yet */
+        static bool needsLoad(const Diagnostic& diag) {
+            if (diag.loc.file && !diag.loc.file->indexed())
+                return true;
+            for (auto& secondary : diag.secondaries)
+                if (secondary->loc.file && !secondary->loc.file->indexed())
+                    return true;
+            for (auto& fix : diag.fixits)
+                if (fix.loc.file && !fix.loc.file->indexed())
+                    return true;
+            return false;
+        }
+
+        /* print a diagnostic, in SHORT style if printing it in RICH style would probably miss the deadline */
+        void render(Diagnostic& diag) {
+            if (config.style != DisplayStyle::RICH || deadline == Clock::time_point::max()) {
+                diag.print(out, config);
+                return;
+            }
+            bool load = needsLoad(diag);
+            auto& cost = load ? loadCost : richCost;
+            auto start = Clock::now();
+            if (!degrading && start + cost > deadline)
+                degrading = true;
+            if (degrading) {
+                config.style = DisplayStyle::SHORT;
+                diag.print(out, config);
+                config.style = DisplayStyle::RICH;
+                degraded.push_back(diag);
+                return;
+            }
+            diag.print(out, config);
+            cost += (Clock::now() - start - cost) / 4;
+        }
+
+        /* keep an error if it is one of the earliest errors seen so far, within what's left of `config.limits.errors` */
+        void hold(Diagnostic diag) {
+            Held entry(std::move(diag), sequence++);
+            size_t budget = config.limits.errors > heldPrinted ? config.limits.errors - heldPrinted : 0;
+            if (held.size() < budget) {
+                held.push_back(std::move(entry));
+                std::push_heap(held.begin(), held.end());
+            } else if (!held.empty() && entry < held.front()) {
+                std::pop_heap(held.begin(), held.end());
+                held.back() = std::move(entry);
+                std::push_heap(held.begin(), held.end());
+                stats.suppress();
+            } else stats.suppress();
+        }
 
-                lastLine = secondary.loc.line;
-                line = currFile->getLine(secondary.loc.line);
-                printLeftWithLineNum(config, out, secondary.loc.line, maxLine);
-                printLine(config, out, line);
-                printSecondariesOnLine(config, out, line, i, maxLine, printAbove);
+        /* print the diagnostics of a file which are before `line` (all of them for the max line), in order */
+        void release(OrderedFile& file, uint32_t line) {
+            auto& waiting = file.waiting;
+            while (!waiting.empty() && (line == std::numeric_limits<uint32_t>::max() || waiting.front().diag.loc.line < line)) {
+                std::pop_heap(waiting.begin(), waiting.end(), std::greater<Waiting>());
+                emit(waiting.back().diag);
+                waiting.pop_back();
             }
-            if (currFile != nullptr)
-                printBottom(config, out, maxLine); 
-            for (; i < secondaries.size(); i++) {
-                auto& secondary = secondaries[i];
-                printLeft(config, out, maxLine, false);
-                secondary.color(config).print(out, toString(config.chars.noteBullet) + " " + secondary.tyToString(config) + ": ");
+        }
 
-                auto lines = splitLines(secondary.msg);
-                
-                for (size_t idx = 0; idx < lines.size(); idx++) {
-                    if (idx != 0) {
-                        printLeft(config, out, maxLine, false);
-                        out << std::string(countChars(secondary.tyToString(config)) + 4, ' ');
-                    }
-                    printLine(config, out, lines[idx]);
+        /* print every diagnostic which can no longer be preceded by a later arrival */
+        void advance() {
+            for (; orderedNext < orderedFiles.size(); orderedNext++) {
+                auto& file = orderedFiles[orderedNext];
+                release(file, file.watermark);
+                if (file.watermark != std::numeric_limits<uint32_t>::max())
+                    break;
+            }
+        }
+
+        /* whether the diagnostic is suppressed by a `reporter: allow(CODE)` comment in its file, as returned by `SourceFile::read()` */
+        static bool allowedInSource(const Diagnostic& diag) {
+            return diag.code != "" && diag.loc.file && diag.loc.file->index()->allows(diag.code, diag.loc.line);
+        }
+
+        /*
+         * hold, queue, or print a diagnostic which isn't suppressed, `Diag` is `Diagnostic` or `const Diagnostic&`:
+         * a diagnostic passed by reference is only copied once it's known to be kept or printed, not if it's collapsed
+         */
+        template<typename Diag>
+        void accept(Diag&& diag) {
+            if (config.limits.errors && diag.isError()) {
+                std::lock_guard<std::mutex> lock(mutex);
+                hold(Diagnostic(std::forward<Diag>(diag)));
+                return;
+            }
+            stats.count(diag); // lock-free, everything which isn't held is printed sooner or later
+            std::lock_guard<std::mutex> lock(mutex);
+            if (ordered) {
+                auto found = orderedIndices.find(diag.loc.file);
+                if (found == orderedIndices.end()) {
+                    unordered.emplace_back(Diagnostic(std::forward<Diag>(diag)));
+                    return;
                 }
+                auto& file = orderedFiles[found->second];
+                file.waiting.emplace_back(Diagnostic(std::forward<Diag>(diag)));
+                std::push_heap(file.waiting.begin(), file.waiting.end(), std::greater<Waiting>());
+                if (found->second < orderedNext) // a late arrival in a file which was already printed, nothing can precede it anymore
+                    release(file, std::numeric_limits<uint32_t>::max());
+                else if (found->second == orderedNext)
+                    advance();
+                return;
             }
-            return *this;
+            if (collapsed(diag))
+                return;
+            Diagnostic printed(std::forward<Diag>(diag)); // rendering sorts the secondaries in place
+            render(printed);
         }
 
-        Diagnostic& print(std::ostream& out, const Config&& config = Config()) { return print(out, config); }
+    public:
+        /**
+         * @param output stream in which to print the diagnostics.
+         * @param cfg the config used to print the diagnostics.
+         */
+        Reporter(std::ostream& output, Config cfg = Config()) : out(output), config(cfg) {}
 
         /**
-         * Adds a secondary note message to the diagnostic at `location`.
-         * @param message the note message.
-         * @param location source code location of the note message.
+         * Print a diagnostic, unless enough similar diagnostics have already been printed.
          * @return the object which this function was called upon.
          */
-        inline Diagnostic& withNote(std::string message, Location location);
-        
+        Reporter& report(Diagnostic&& diag) {
+            if ((baseline && baseline->contains(diag)) || allowedInSource(diag)) {
+                stats.suppress();
+                return *this;
+            }
+            accept(std::move(diag));
+            return *this;
+        }
+
         /**
-         * Adds a secondary help message to the diagnostic at `location`.
-         * @param message the help message.
-         * @param location source code location of the help message.
+         * Print a copy of a diagnostic, unless enough similar diagnostics have already been printed.
+         * The diagnostic is only copied once it is known not to be suppressed or collapsed, so such diagnostics
+         * (e.g. ones from a `DiagnosticPool`) are reported without being copied.
          * @return the object which this function was called upon.
          */
-        inline Diagnostic& withHelp(std::string message, Location location);
+        Reporter& report(const Diagnostic& diag) {
+            if ((baseline && baseline->contains(diag)) || allowedInSource(diag)) {
+                stats.suppress();
+                return *this;
+            }
+            accept(diag);
+            return *this;
+        }
 
         /**
-         * Adds a secondary note message to the diagnostic without a specific location.
-         * @param message the note message.
+         * Report a batch of diagnostics, in order of their locations (see `sortByLocation`).
          * @return the object which this function was called upon.
          */
-        inline Diagnostic& withNote(std::string message) { return withNote(message, {}); }
+        Reporter& report(std::vector<Diagnostic> diags) {
+            sortByLocation(diags);
+            for (auto& diag : diags)
+                report(std::move(diag));
+            return *this;
+        }
 
         /**
-         * Adds a secondary help message to the diagnostic without a specific location.
-         * @param message the help message.
+         * Print the errors held back by `config.limits.errors`, followed by a summary of all diagnostics which were collapsed since the last flush.
          * @return the object which this function was called upon.
          */
-        Diagnostic& withHelp(std::string message) { return withHelp(message, {}); }
+        Reporter& flush() {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (ordered) {
+                for (auto& file : orderedFiles) {
+                    file.watermark = std::numeric_limits<uint32_t>::max();
+                    release(file, file.watermark);
+                }
+                std::sort(unordered.begin(), unordered.end(), [](const Waiting& a, const Waiting& b) {
+                    auto fileA = a.diag.loc.file, fileB = b.diag.loc.file;
+                    if (!fileA != !fileB)
+                        return fileB == nullptr;
+                    if (fileA != fileB && fileA->str() != fileB->str())
+                        return fileA->str() < fileB->str();
+                    return b > a;
+                });
+                for (auto& entry : unordered)
+                    emit(entry.diag);
+                unordered.clear();
+                orderedFiles.clear();
+                orderedIndices.clear();
+                ordered = false;
+            }
+            std::sort_heap(held.begin(), held.end());
+            heldPrinted += held.size();
+            for (auto& entry : held) {
+                stats.count(entry.diag);
+                emit(entry.diag);
+            }
+            held.clear();
+            for (auto& group : groups)
+                if (group.collapsed)
+                    printCollapsed(group);
+            groups.clear();
+            groupIndices.clear();
+            out.flush();
+            return *this;
+        }
 
-    private:
-        Diagnostic& with(Diagnostic diag) {
-            if (diag.loc.file != nullptr) 
-                for (auto& i : secondaries)
-                    if (i.loc == diag.loc) {
-                        i.with(diag);
-                        return *this;
-                    }
-            secondaries.push_back(diag);
-            return *this; 
+        /**
+         * Suppress every diagnostic which is in `known`. The baseline must outlive the reporter.
+         * @return the object which this function was called upon.
+         */
+        Reporter& suppress(const Baseline& known) {
+            baseline = &known;
+            return *this;
         }
-    };
 
-    /////////////////////////////////////////////////////////////////////////
+        /**
+         * Start ordered mode: until the next `flush()`, diagnostics are printed ordered by file path, line and column
+         * (and by `Diagnostic::hash()` between identical locations), no matter in which order they are reported.
+         * A diagnostic is printed as soon as every file before its own is complete, and its line is before its file's watermark.
+         * Diagnostics of files which aren't in `files`, and diagnostics without a file, are printed last, by `flush()`.
+         * A diagnostic reported before its file's watermark after all (e.g. into a completed file) is printed as soon as possible.
+         * @param files every file diagnostics may be reported in.
+         * @return the object which this function was called upon.
+         */
+        Reporter& order(const std::vector<SourceFile*>& files) {
+            std::lock_guard<std::mutex> lock(mutex);
+            ordered = true;
+            orderedFiles.clear();
+            orderedIndices.clear();
+            orderedNext = 0;
+            for (auto file : files)
+                orderedFiles.push_back(OrderedFile { file, file->str(), 0, {} });
+            std::stable_sort(orderedFiles.begin(), orderedFiles.end(), [](const OrderedFile& a, const OrderedFile& b) { return a.path < b.path; });
+            for (size_t i = 0; i < orderedFiles.size(); i++)
+                orderedIndices.emplace(orderedFiles[i].file, i);
+            return *this;
+        }
 
-    template<DiagnosticType T>
-    class DiagnosticTy : public Diagnostic {
-    public:
         /**
-         * Constructs a minimal diagnostic message, without a specific source code location.
-         * @param message the diagnostic message - should essentially be the 'title' of the diagnostic without going into too much detail.
+         * In ordered mode, promise that no more diagnostics will be reported in `file` before `line`, printing every
+         * diagnostic which can no longer be preceded by one reported later. Watermarks only ever move forward.
+         * @param file a file passed to `order()`.
+         * @param line the watermark, by default the whole file is complete.
+         * @return the object which this function was called upon.
          */
-        DiagnosticTy<T>(std::string message) : Diagnostic(T, message) {}
+        Reporter& complete(SourceFile* file, uint32_t line = std::numeric_limits<uint32_t>::max()) {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto found = orderedIndices.find(file);
+            if (!ordered || found == orderedIndices.end())
+                return *this;
+            auto& watermark = orderedFiles[found->second].watermark;
+            watermark = std::max(watermark, line);
+            if (found->second == orderedNext)
+                advance();
+            return *this;
+        }
 
         /**
-         * Constructs a simple diagnostic with a message and a source code location.
-         * @param message the diagnostic message - should essentially be the 'title' of the diagnostic without going into too much detail.
-         * @param location the location the diagnostic is concerning.
+         * Set the time by which the diagnostics reported from now on should be printed.
+         * Diagnostics which would miss it are printed in SHORT style instead (see `takeDegraded()`).
+         * @param time the deadline, `Clock::time_point::max()` for none (the default).
+         * @return the object which this function was called upon.
          */
-        DiagnosticTy<T>(std::string message, Location location) : Diagnostic(T, message, location) {}
+        Reporter& setDeadline(Clock::time_point time) {
+            std::lock_guard<std::mutex> lock(mutex);
+            deadline = time;
+            degrading = false;
+            return *this;
+        }
 
         /**
-         * Constructs a diagnostic at a specific source code location with both a primary message and a submessage.
-         * @param message the diagnostic message - should essentially be the 'title' of the diagnostic without going into too much detail.
-         * @param subMessage the secondary message which is printed directly next to the source code.
-         * @param location the location the diagnostic is concerning.
+         * @return the diagnostics which were printed in SHORT style to meet a deadline since the last call, in the order they were printed.
          */
-        DiagnosticTy<T>(std::string message, std::string subMessage, Location location) : Diagnostic(T, message, subMessage, location) {}
+        std::vector<Diagnostic> takeDegraded() {
+            std::lock_guard<std::mutex> lock(mutex);
+            std::vector<Diagnostic> ret;
+            ret.swap(degraded);
+            return ret;
+        }
 
         /**
-         * Constructs a diagnostic at a specific source code location with both a primary message and a submessage, as well as a custom error code.
-         * @param message the diagnostic message - should essentially be the 'title' of the diagnostic without going into too much detail.
-         * @param subMessage the secondary message which is printed directly next to the source code.
-         * @param code the error code, can be anything but is usually something like `"E101"` or `"W257"`, for example.
-         * @param location the location the diagnostic is concerning.
+         * @return the counters of every diagnostic passed to this reporter.
          */
-        DiagnosticTy<T>(std::string message, std::string subMessage, std::string code, Location location) : Diagnostic(T, message, subMessage, code, location) {}
+        Statistics& statistics() { return stats; }
 
         /**
-         * Pretty-print the diagnostic.
-         * @param out stream in which to print the error.
+         * Print a one line summary of every diagnostic passed to this reporter.
          * @return the object which this function was called upon.
          */
-        DiagnosticTy<T>& print(std::ostream& out, const Config& config)             { Diagnostic::print(out, config); return *this; }
-        DiagnosticTy<T>& print(std::ostream& out, const Config&& config = Config()) { Diagnostic::print(out, config); return *this; }
+        Reporter& printSummary() {
+            std::lock_guard<std::mutex> lock(mutex);
+            stats.print(out);
+            return *this;
+        }
+    };
+
+    /////////////////////////////////////////////////////////////////////////
+
+    /**
+     * Reports diagnostics to a `Reporter` from a background thread, so producers don't wait for rendering.
+     * Queued diagnostics wait in one lane per diagnostic type, and the lanes are served by priority:
+     * internal errors, then errors, warnings, notes, and help messages. To keep lower lanes from starving,
+     * every `fairness`-th diagnostic taken is the oldest one in the queue, whatever its lane.
+     *
+     * Once `capacity` diagnostics are queued, producers wait for room - unless `dropLowPriority` is set, in which case
+     * the newest warning, note or help message of a lower lane than the new diagnostic is dropped to make room for it,
+     * and a new warning, note or help message with nothing below it is dropped itself. Errors are never dropped.
+     * Dropped diagnostics are counted in the reporter's `Statistics`.
+     * All member functions are thread safe.
+     */
+    class AsyncWriter {
+    private:
+        static const size_t laneCount = 5;
+        static const size_t lowPriority = 2; // the first lane which may be dropped from
 
+        struct Item {
+            Diagnostic diag;
+            uint64_t seq; // order of arrival
+        };
+
+        Reporter& reporter;
+        size_t capacity;
+        bool dropLowPriority;
+        unsigned fairness;
+
+        std::mutex mutex;
+        std::condition_variable notEmpty, notFull, idle;
+        std::deque<Item> lanes[laneCount];
+        size_t queued = 0;
+        uint64_t sequence = 0;
+        unsigned sinceOldest = 0; // diagnostics taken by priority since the oldest one was last taken
+        bool busy = false;        // whether the worker is reporting a diagnostic
+        bool stopping = false;
+        std::thread worker;
+
+        static size_t lane(DiagnosticType ty) {
+            switch (ty) {
+                case DiagnosticType::INTERNAL_ERROR:
+                case DiagnosticType::UNKNOWN: return 0;
+                case DiagnosticType::ERROR:   return 1;
+                case DiagnosticType::WARNING: return 2;
+                case DiagnosticType::NOTE:    return 3;
+                case DiagnosticType::HELP:    return 4;
+            }
+            return 0;
+        }
+
+        /* the lane to take the next diagnostic from, there must be a queued diagnostic */
+        size_t next() {
+            size_t ret = 0;
+            while (lanes[ret].empty())
+                ret++;
+            if (fairness && ++sinceOldest >= fairness) {
+                sinceOldest = 0;
+                for (size_t i = ret + 1; i < laneCount; i++)
+                    if (!lanes[i].empty() && lanes[i].front().seq < lanes[ret].front().seq)
+                        ret = i;
+            }
+            return ret;
+        }
+
+        void run() {
+            std::unique_lock<std::mutex> lock(mutex);
+            for (;;) {
+                notEmpty.wait(lock, [this] { return queued || stopping; });
+                if (!queued)
+                    return;
+                auto& from = lanes[next()];
+                Diagnostic diag = std::move(from.front().diag);
+                from.pop_front();
+                queued--;
+                busy = true;
+                notFull.notify_one();
+                lock.unlock();
+                reporter.report(std::move(diag));
+                lock.lock();
+                busy = false;
+                if (!queued)
+                    idle.notify_all();
+            }
+        }
+
+    public:
         /**
-         * Adds a secondary note message to the diagnostic at `location`.
-         * @param message the note message.
-         * @param location source code location of the note message.
-         * @return the object which this function was called upon.
+         * @param output the reporter to report the diagnostics to, must outlive the writer.
+         * @param capacity the maximum number of queued diagnostics.
+         * @param dropLowPriority whether to drop warnings, notes and help messages instead of waiting when the queue is full.
+         * @param fairness every `fairness`-th diagnostic is taken in order of arrival rather than by priority, 0 to always go by priority.
          */
-        DiagnosticTy<T>& withNote(std::string message, Location location) { Diagnostic::withNote(message, location); return *this; }
+        AsyncWriter(Reporter& output, size_t capacity = 1024, bool dropLowPriority = false, unsigned fairness = 8)
+                : reporter(output), capacity(capacity ? capacity : 1), dropLowPriority(dropLowPriority), fairness(fairness),
+                  worker(&AsyncWriter::run, this) {}
+
+        AsyncWriter(const AsyncWriter&) = delete;
+        AsyncWriter& operator=(const AsyncWriter&) = delete;
 
         /**
-         * Adds a secondary help message to the diagnostic at `location`.
-         * @param message the help message.
-         * @param location source code location of the help message.
-         * @return the object which this function was called upon.
+         * Report the queued diagnostics, then stop the background thread.
          */
-        DiagnosticTy<T>& withHelp(std::string message, Location location) { Diagnostic::withHelp(message, location); return *this; }
+        ~AsyncWriter() {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            notEmpty.notify_one();
+            worker.join();
+        }
 
         /**
-         * Adds a secondary note message to the diagnostic without a specific location.
-         * @param message the note message.
+         * Queue a diagnostic to be reported, waiting for room if the queue is full (see `dropLowPriority`).
          * @return the object which this function was called upon.
          */
-        DiagnosticTy<T>& withNote(std::string message) { Diagnostic::withNote(message); return *this; }
+        AsyncWriter& report(Diagnostic diag) {
+            size_t to = lane(diag.type());
+            std::unique_lock<std::mutex> lock(mutex);
+            while (queued >= capacity) {
+                if (dropLowPriority) {
+                    size_t victim = laneCount - 1;
+                    while (victim > to && victim >= lowPriority && lanes[victim].empty())
+                        victim--;
+                    if (victim > to && victim >= lowPriority) {
+                        lanes[victim].pop_back();
+                        queued--;
+                        reporter.statistics().drop();
+                        break;
+                    }
+                    if (to >= lowPriority) {
+                        reporter.statistics().drop();
+                        return *this;
+                    }
+                }
+                notFull.wait(lock);
+            }
+            lanes[to].push_back(Item { std::move(diag), sequence++ });
+            queued++;
+            notEmpty.notify_one();
+            return *this;
+        }
 
         /**
-         * Adds a secondary help message to the diagnostic without a specific location.
-         * @param message the help message.
+         * Wait until every queued diagnostic was reported, then flush the reporter.
          * @return the object which this function was called upon.
          */
-        DiagnosticTy<T>& withHelp(std::string message) { Diagnostic::withHelp(message); return *this; }
+        AsyncWriter& flush() {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                idle.wait(lock, [this] { return !queued && !busy; });
+            }
+            reporter.flush();
+            return *this;
+        }
     };
 
     /////////////////////////////////////////////////////////////////////////
 
     /**
-     * An `internal error` diagnostic type. 
-     * These should (ideally) never be shown to the client, rather they should be used as a debugging tool for the compiler developer.
+     * Publishes per-file diagnostic lists, for example to a language server client.
+     * Updates to a file are coalesced - a file is published once no newer update arrived for `window`,
+     * and updates for older versions than the latest one are dropped.
+     * Only the difference from the last published list of the file is published: diagnostics are compared by
+     * `Diagnostic::hash()`, so unchanged diagnostics are never re-rendered or re-sent, and unchanged lists are not published at all.
+     * All member functions are thread safe.
      */
-    typedef DiagnosticTy<DiagnosticType::INTERNAL_ERROR> InternalError;
+    class Publisher {
+    public:
+        typedef std::chrono::steady_clock Clock;
 
-    /**
-     * An `error` diagnostic type. 
-     * These are usually errors which stop the compilation process from being competed.
-     */
-    typedef DiagnosticTy<DiagnosticType::ERROR> Error;
+        /**
+         * The changes to a file's diagnostics since it was last published.
+         */
+        struct Publication {
+            SourceFile* file;
+            uint64_t version;
+            std::vector<Diagnostic> added;  // diagnostics which were not in the last published list
+            std::vector<uint64_t> removed;  // hashes of diagnostics which are no longer in the list
+            size_t unchanged;               // number of diagnostics which were already published
+        };
 
-    /**
-     * A `warning` diagnostic type.
-     * These don't necessarily halt the compilation process, but they hint at a possible error in the programmer's code.
-     */
-    typedef DiagnosticTy<DiagnosticType::WARNING> Warning;
+    private:
+        struct Pending {
+            uint64_t version;
+            std::vector<Diagnostic> diags;
+            Clock::time_point due;
+        };
 
-    /**
-     * A `note` diagnostic type.
-     * Should be used to supplement the `Error`/`Warning` diagnostic, and give useful inforation to solve the issue.
-     */
-    typedef DiagnosticTy<DiagnosticType::NOTE> Note;
+        struct Published {
+            uint64_t version;
+            std::vector<uint64_t> hashes; // sorted
+        };
+
+        std::function<void(Publication&)> publish;
+        Clock::duration window;
+        std::mutex mutex;
+        std::unordered_map<SourceFile*, Pending> pending;
+        std::unordered_map<SourceFile*, Published> published;
+
+        /* compute the difference between a pending list and the last published list of `file` */
+        Publication diff(SourceFile* file, Pending& update) {
+            Publication pub { file, update.version, {}, {}, 0 };
+            auto& last = published[file];
+            last.version = update.version;
+
+            std::vector<std::pair<uint64_t, size_t>> current; // hash, index in `update.diags`
+            current.reserve(update.diags.size());
+            for (size_t i = 0; i < update.diags.size(); i++)
+                current.push_back({ update.diags[i].hash(), i });
+            std::sort(current.begin(), current.end());
+
+            // both lists are sorted, walk them together like a merge
+            size_t i = 0, j = 0;
+            while (i < current.size() || j < last.hashes.size()) {
+                if (j == last.hashes.size() || (i < current.size() && current[i].first < last.hashes[j]))
+                    pub.added.push_back(std::move(update.diags[current[i++].second]));
+                else if (i == current.size() || last.hashes[j] < current[i].first)
+                    pub.removed.push_back(last.hashes[j++]);
+                else {
+                    pub.unchanged++;
+                    i++;
+                    j++;
+                }
+            }
+
+            last.hashes.clear();
+            for (auto& c : current)
+                last.hashes.push_back(c.first);
+            return pub;
+        }
+
+    public:
+        /**
+         * @param callback called with every publication, from the thread calling `poll()`.
+         * @param debounce how long a file has to go without updates before it is published.
+         */
+        Publisher(std::function<void(Publication&)> callback, Clock::duration debounce = std::chrono::milliseconds(100))
+            : publish(callback), window(debounce) {}
+
+        /**
+         * Replace the diagnostics of `file`. Ignored if a newer version of the file was already updated.
+         * @param file the file the diagnostics belong to.
+         * @param version the version of the file the diagnostics were computed for.
+         * @param diags the full list of the file's diagnostics.
+         * @param now the current time.
+         */
+        void update(SourceFile* file, uint64_t version, std::vector<Diagnostic> diags, Clock::time_point now = Clock::now()) {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto last = published.find(file);
+            if (last != published.end() && last->second.version > version)
+                return;
+            auto found = pending.find(file);
+            if (found != pending.end() && found->second.version > version)
+                return;
+            pending[file] = Pending { version, std::move(diags), now + window };
+        }
+
+        /**
+         * Publish every file which was not updated for the debounce window.
+         * @param now the current time.
+         * @return the number of publications.
+         */
+        size_t poll(Clock::time_point now = Clock::now()) {
+            std::vector<Publication> pubs;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                for (auto it = pending.begin(); it != pending.end();) {
+                    if (it->second.due > now) {
+                        it++;
+                        continue;
+                    }
+                    auto pub = diff(it->first, it->second);
+                    if (!pub.added.empty() || !pub.removed.empty())
+                        pubs.push_back(std::move(pub));
+                    it = pending.erase(it);
+                }
+            }
+            for (auto& pub : pubs)
+                publish(pub);
+            return pubs.size();
+        }
+
+        /**
+         * @return when the next call to `poll()` will have something to publish, or `Clock::time_point::max()` if nothing is pending.
+         */
+        Clock::time_point next() {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto ret = Clock::time_point::max();
+            for (auto& p : pending)
+                ret = std::min(ret, p.second.due);
+            return ret;
+        }
+
+        /**
+         * Forget a file (for example once it is closed), dropping any pending update.
+         */
+        void close(SourceFile* file) {
+            std::lock_guard<std::mutex> lock(mutex);
+            pending.erase(file);
+            published.erase(file);
+        }
+    };
+
+#ifdef REPORTER_POSIX
+
+    /////////////////////////////////////////////////////////////////////////
 
     /**
-     * A `help` diagnostic type.
-     * Usually used to give useful hints at how to fix an issue.
+     * Reports an internal error when nothing else can be relied on, such as from a signal handler or once memory ran out.
+     * Everything which may allocate is done in advance by the constructor and by `setLocation()`, while `emit()` only
+     * formats into a preallocated buffer and writes it with `write(2)` - it is async-signal-safe, never takes a lock,
+     * and runs in bounded time. The output is uncolored, in SHORT style, optionally followed by the line of the location:
+     *
+     *     main.dn:12:4:9: Internal Error(ICE1): segmentation fault
+     *      12 │     foo(bar);
+     *         │     ^^^^^
      */
-    typedef DiagnosticTy<DiagnosticType::HELP> Help;
+    class EmergencyEmitter {
+    public:
+        /* bytes of output `emit()` can produce, anything beyond is cut off */
+        static constexpr size_t bufferSize = 4096;
+        /* bytes of the file path and of the source line which are kept by `setLocation()` */
+        static constexpr size_t maxPath = 512;
+        static constexpr size_t maxLine = 256;
 
-    Diagnostic& Diagnostic::withNote(std::string message, Location location) { return with(Note(message, location)); }
-    Diagnostic& Diagnostic::withHelp(std::string message, Location location) { return with(Help(message, location)); }
+    private:
+        /* a location, copied along with everything needed to print it */
+        struct Prepared {
+            SourceFile* file = nullptr;
+            uint32_t line = 0, start = 0, end = 0;
+            char path[maxPath];
+            size_t pathSize = 0;
+            char text[maxLine];
+            size_t textSize = 0;
+            bool hasText = false;
+        };
+
+        int fd;
+        std::string name, bracketLeft, bracketRight, border, arrow;
+
+        // `setLocation()` fills the slot which isn't current, then flips `current`. A slot's generation is odd while it is written,
+        // so `emit()` can tell if two more `setLocation()` calls rewrote the slot while it was copying it, and try again
+        Prepared prepared[2];
+        std::atomic<unsigned> current;
+        std::atomic<unsigned> generation[2];
+
+        std::atomic_flag busy;
+        char buffer[bufferSize];
+        size_t used = 0;
+
+        void append(const char* str, size_t size) {
+            if (size > bufferSize - used)
+                size = bufferSize - used;
+            std::memcpy(buffer + used, str, size);
+            used += size;
+        }
+
+        void append(const std::string& str) { append(str.data(), str.size()); }
+
+        void append(char c, size_t count = 1) {
+            for (size_t i = 0; i < count && used < bufferSize; i++)
+                buffer[used++] = c;
+        }
+
+        void append(uint32_t n) {
+            char digits[10];
+            size_t count = 0;
+            do {
+                digits[count++] = static_cast<char>('0' + n % 10);
+                n /= 10;
+            } while (n);
+            while (count)
+                append(digits[--count]);
+        }
+
+        static size_t digitCount(uint32_t n) {
+            size_t count = 1;
+            while (n >= 10) {
+                n /= 10;
+                count++;
+            }
+            return count;
+        }
+
+        /* writes the buffer, retrying partial and interrupted writes a bounded number of times */
+        bool flush() {
+            size_t written = 0;
+            for (int interrupts = 0; written < used && interrupts < 8;) {
+                ssize_t n = ::write(fd, buffer + written, used - written);
+                if (n > 0)
+                    written += static_cast<size_t>(n);
+                else if (n < 0 && errno == EINTR)
+                    interrupts++;
+                else break;
+            }
+            return written == used;
+        }
+
+    public:
+        /**
+         * @param fd file descriptor to write to.
+         * @param config only the names and characters are used, the style and colors are ignored.
+         */
+        explicit EmergencyEmitter(int fd = STDERR_FILENO, const Config& config = Config())
+                : fd(fd), name(config.chars.internalErrorName),
+                  bracketLeft(Diagnostic::toString(config.chars.errCodeBracketLeft)),
+                  bracketRight(Diagnostic::toString(config.chars.errCodeBracketRight)),
+                  border(Diagnostic::toString(config.chars.borderVertical)),
+                  arrow(Diagnostic::toString(config.chars.arrowUp)), current(0) {
+            generation[0].store(0);
+            generation[1].store(0);
+            busy.clear();
+        }
+
+        EmergencyEmitter(const EmergencyEmitter&) = delete;
+        EmergencyEmitter& operator=(const EmergencyEmitter&) = delete;
+
+        /**
+         * Set the location reported by `emit()`, for example the construct currently being compiled.
+         * Copies the file's path and the line of the location, reading the file if it wasn't read yet.
+         * Not async-signal-safe, and must not be called from two threads at once.
+         */
+        void setLocation(Location loc) {
+            unsigned next = current.load(std::memory_order_relaxed) ^ 1;
+            const Prepared& last = prepared[next ^ 1];
+            Prepared& p = prepared[next];
+            unsigned gen = generation[next].load(std::memory_order_relaxed);
+            generation[next].store(gen + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            if (loc.file && loc.file == last.file) {
+                std::memcpy(p.path, last.path, last.pathSize);
+                p.pathSize = last.pathSize;
+            }
+            else if (loc.file) {
+                auto path = loc.file->str();
+                p.pathSize = path.size() < maxPath ? path.size() : size_t(maxPath);
+                std::memcpy(p.path, path.data(), p.pathSize);
+            }
+            p.file = loc.file;
+            p.line = loc.line;
+            p.start = loc.start;
+            p.end = loc.end;
+            size_t size = 0;
+            auto index = loc.file ? loc.file->index() : nullptr;
+            const char* text = index ? index->line(loc.line, size) : nullptr;
+            p.hasText = text != nullptr;
+            p.textSize = size < maxLine ? size : size_t(maxLine);
+            if (text)
+                std::memcpy(p.text, text, p.textSize);
+            generation[next].store(gen + 2, std::memory_order_release);
+            current.store(next, std::memory_order_release);
+        }
+
+        /**
+         * Write an internal error at the location last given to `setLocation()`.
+         * Async-signal-safe: doesn't allocate, lock, or use iostreams, and preserves `errno`.
+         * @param message the error message.
+         * @param code the error code, nullptr for none.
+         * @param snippet whether to print the line of the location under the message.
+         * @return whether the whole error was written, false if another thread is in the middle of emitting.
+         */
+        bool emit(const char* message, const char* code = nullptr, bool snippet = true) {
+            if (busy.test_and_set(std::memory_order_acquire))
+                return false;
+            int savedErrno = errno;
+            Prepared at;
+            bool located = false;
+            for (int attempt = 0; attempt < 4 && !located; attempt++) {
+                unsigned slot = current.load(std::memory_order_acquire);
+                unsigned gen = generation[slot].load(std::memory_order_acquire);
+                if (gen & 1)
+                    continue;
+                at = prepared[slot];
+                std::atomic_thread_fence(std::memory_order_acquire);
+                located = generation[slot].load(std::memory_order_relaxed) == gen;
+            }
+            if (!located) { // the location kept changing, rather print none than a torn one
+                at.file = nullptr;
+                at.hasText = false;
+            }
+            used = 0;
+
+            if (at.file) {
+                append(at.path, at.pathSize);
+                append(':');
+                append(at.line);
+                append(':');
+                append(at.start);
+                append(':');
+                append(at.end);
+                append(": ", 2);
+            }
+            append(name);
+            if (code && *code) {
+                append(bracketLeft);
+                append(code, std::strlen(code));
+                append(bracketRight);
+            }
+            append(": ", 2);
+            append(message, std::strlen(message));
+            append('\n');
+
+            if (snippet && at.hasText) {
+                size_t width = digitCount(at.line);
+                append(' ');
+                append(at.line);
+                append(' ');
+                append(border);
+                append(' ');
+                append(at.text, at.textSize);
+                append('\n');
+                append(' ', width + 2);
+                append(border);
+                append(' ');
+                for (size_t i = 0; i < at.textSize && i < at.end; i++) {
+                    if ((static_cast<unsigned char>(at.text[i]) & 0xC0) == 0x80)
+                        continue; // one column per character, not per byte
+                    if (i >= at.start)
+                        append(arrow);
+                    else append(at.text[i] == '\t' ? '\t' : ' ');
+                }
+                append('\n');
+            }
+
+            bool ok = flush();
+            errno = savedErrno;
+            busy.clear(std::memory_order_release);
+            return ok;
+        }
+    };
+
+#endif /* REPORTER_POSIX */
 }
 
+#undef REPORTER_POSIX
+
 #endif /* DIAGNOSTIC_REPORTER_HPP_INCLUDED */
@@ -0,0 +1,518 @@
+#include "reporter.hpp"
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <thread>
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Behavior checks of the reporter, exits with 1 if any of them fails.
+// Build with: g++ -std=c++11 -pthread test.cpp -o test && ./test
+
+#define CHECK(cond) do { if (!(cond)) { std::cerr << "check failed: " #cond " (line " << __LINE__ << ")\n"; return false; } } while (0)
+
+// a temporary directory for the files of a check, removed along with them once the check is done
+class TempDir {
+    std::string dir;
+    std::vector<std::string> files;
+public:
+    TempDir() {
+#if defined(__unix__) || defined(__APPLE__)
+        auto tmp = std::getenv("TMPDIR");
+        std::string name = std::string(tmp && *tmp ? tmp : "/tmp") + "/reporter_test_XXXXXX";
+        dir = mkdtemp(&name[0]) ? name : ".";
+#else
+        dir = ".";
+#endif
+    }
+
+    ~TempDir() {
+        for (auto& file : files)
+            std::remove(file.c_str());
+#if defined(__unix__) || defined(__APPLE__)
+        if (dir != ".")
+            rmdir(dir.c_str());
+#endif
+    }
+
+    /** @return the path of a new file in the directory, with `contents` written to it. */
+    std::string file(const std::string& name, const std::string& contents) {
+        auto path = dir + "/" + name;
+        std::ofstream(path, std::ios::binary) << contents;
+        files.push_back(path);
+        return path;
+    }
+};
+
+static std::string readAll(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    return std::string((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+}
+
+static reporter::Config shortConfig() {
+    reporter::Config cfg;
+    cfg.style = reporter::DisplayStyle::SHORT;
+    return cfg;
+}
+
+/////////////////////////////////////////////////////////////////////////
+
+// diagnostics allowed by a comment on their line or the line above, or known to a baseline, are suppressed
+static bool checkSuppression() {
+    TempDir tmp;
+    reporter::SimpleFile file(tmp.file("a.dn", "let a = 1 // reporter: allow(E1)\n// reporter: allow(E2)\nlet b = 2\nlet c = 3\n"));
+    std::ostringstream out;
+    reporter::Reporter rep(out, shortConfig());
+    rep.report(reporter::Error("one", "", "E1", { 1, 4, 5, &file }));
+    rep.report(reporter::Error("two", "", "E2", { 3, 4, 5, &file }));
+    rep.report(reporter::Error("three", "", "E2", { 4, 4, 5, &file }));
+    rep.flush();
+    CHECK(out.str().find("one") == std::string::npos);
+    CHECK(out.str().find("two") == std::string::npos);
+    CHECK(out.str().find("three") != std::string::npos);
+
+    auto known = reporter::Error("known", "", "E3", { 4, 4, 5, &file });
+    reporter::Baseline baseline;
+    baseline.add(reporter::Baseline::fingerprint(known));
+    auto path = tmp.file("baseline.bin", "");
+    CHECK(baseline.save(path));
+    reporter::Baseline loaded;
+    CHECK(loaded.load(path) && loaded.size() == 1);
+    rep.suppress(loaded);
+    rep.report(known);
+    CHECK(rep.statistics().suppressed() == 3);
+
+    // a truncated baseline is rejected instead of being read past its end
+    auto contents = readAll(path);
+    CHECK(!loaded.load(tmp.file("truncated.bin", contents.substr(0, contents.size() - 8))));
+    return true;
+}
+
+// a file whose contents come from `read()` is printed, suppressed and fingerprinted from those same contents
+static bool checkInMemoryFile() {
+    struct Buffer : reporter::SourceFile {
+        std::string str() override { return "unsaved.dn"; }
+        std::string read() override { return "let a = 1 // reporter: allow(E1)\nlet b = 2\n"; }
+    } buffer;
+    std::ostringstream out;
+    reporter::Reporter rep(out, reporter::Config());
+    rep.report(reporter::Error("one", "", "E1", { 1, 4, 5, &buffer }));
+    rep.report(reporter::Error("two", "", "E2", { 2, 4, 5, &buffer }));
+    rep.flush();
+    CHECK(rep.statistics().suppressed() == 1);
+    CHECK(out.str().find("let b = 2") != std::string::npos);
+    reporter::SimpleFile other("missing.dn");
+    CHECK(reporter::Baseline::fingerprint(reporter::Error("two", "", "E2", { 2, 4, 5, &buffer }))
+       != reporter::Baseline::fingerprint(reporter::Error("two", "", "E2", { 2, 4, 5, &other })));
+    return true;
+}
+
+// similar diagnostics past `limits.similar` are summarized, counting each one even if they share a line
+static bool checkCollapse() {
+    reporter::SimpleFile file("a.dn");
+    auto cfg = shortConfig();
+    cfg.limits.similar = 1;
+    std::ostringstream out;
+    reporter::Reporter rep(out, cfg);
+    rep.report(reporter::Error("bad", "", "E1", { 1, 0, 1, &file }));
+    rep.report(reporter::Error("bad", "", "E1", { 2, 0, 1, &file }));
+    const reporter::Diagnostic sameLine = reporter::Error("bad", "", "E1", { 2, 3, 4, &file });
+    rep.report(sameLine); // reported by reference, collapsed without being copied
+    rep.report(reporter::Error("bad", "", "E1", { 5, 0, 1, &file }));
+    rep.report(reporter::Error("bad", "", "E1", {}));
+    rep.flush();
+    CHECK(out.str() == "a.dn:1:0:1: Error(E1): bad\n"
+                       "Error(E1): and 3 more in a.dn at lines 2, 5\n"
+                       "Error(E1): and 1 more\n");
+    CHECK(rep.statistics().emitted(reporter::DiagnosticType::ERROR) == 5);
+
+    // diagnostics of another kind are another group, even with the same code and message
+    std::ostringstream kinds;
+    reporter::Reporter other(kinds, cfg);
+    other.report(reporter::Error("bad", "", "E1", {}));
+    other.report(reporter::Warning("bad", "", "E1", {}));
+    other.report(reporter::Warning("bad", "", "E1", {}));
+    other.flush();
+    CHECK(kinds.str() == "Error(E1): bad\nWarning(E1): bad\nWarning(E1): and 1 more\n");
+    return true;
+}
+
+// `limits.errors` keeps the earliest errors by location, with one budget for every flush
+static bool checkHeldErrors() {
+    reporter::SimpleFile file("a.dn");
+    auto cfg = shortConfig();
+    cfg.limits.errors = 2;
+    std::ostringstream out;
+    reporter::Reporter rep(out, cfg);
+    rep.report(reporter::Error("c", { 3, 0, 1, &file }));
+    rep.flush();
+    rep.report(reporter::Error("b", { 2, 0, 1, &file }));
+    rep.report(reporter::Error("a", { 1, 0, 1, &file }));
+    rep.flush();
+    rep.report(reporter::Error("z", { 1, 0, 1, &file }));
+    rep.flush();
+    CHECK(out.str() == "a.dn:3:0:1: Error: c\na.dn:1:0:1: Error: a\n");
+    CHECK(rep.statistics().suppressed() == 2);
+    return true;
+}
+
+// secondaries beyond the budgets are left out and summarized, notes and help messages apart
+static bool checkElision() {
+    TempDir tmp;
+    reporter::SimpleFile file(tmp.file("a.dn", "let value = other + 1\n"));
+    auto cfg = shortConfig();
+    cfg.limits.secondariesPerFile = 1;
+    std::ostringstream out;
+    reporter::Error("e", { 1, 0, 1, &file })
+        .withNote("kept", { 1, 7, 8, &file })
+        .withHelp("help", { 1, 2, 3, &file })
+        .withNote("note", { 1, 4, 5, &file })
+        .print(out, cfg);
+    CHECK(out.str().find("kept") != std::string::npos);
+    CHECK(out.str().find("Note: and 1 more note and 1 more help message") != std::string::npos);
+    CHECK(out.str().find("help\n") == std::string::npos);
+    return true;
+}
+
+// locations in generated code are moved to their origin, along with fix-its and backtrace frames
+static bool checkSourceMap() {
+    reporter::SimpleFile generated("gen.dn"), origin("tmpl.dn");
+    reporter::SourceMap map({ { &generated, 10, 5, &origin, 2, -1 } });
+    reporter::Backtraces traces;
+    auto frame = traces.push(reporter::Backtraces::none, "in expansion", { 11, 2, 3, &generated });
+    auto cfg = shortConfig();
+    cfg.sourceMap = &map;
+    std::ostringstream out;
+    reporter::Error("e", { 12, 3, 4, &generated }).withFixIt({ 12, 3, 4, &generated }, "x").withBacktrace(traces, frame).print(out, cfg);
+    CHECK(out.str() == "tmpl.dn:4:2:3: Error: e\n"
+                       "Note: generated code at gen.dn:12:3\n"
+                       "tmpl.dn:3:1:2: Note: in expansion\n"
+                       "tmpl.dn:4:2:3: Fix: \"x\"\n");
+    return true;
+}
+
+// templated messages are formatted when printed, and diagnostics of the same template are grouped whatever their arguments
+static bool checkTemplates() {
+    static const reporter::MessageTemplate mismatch("expected '{}' but found '{}'");
+    CHECK(reporter::Error(mismatch, { "int", "bool" }).message() == "expected 'int' but found 'bool'");
+    auto cfg = shortConfig();
+    cfg.limits.similar = 1;
+    std::ostringstream out;
+    reporter::Reporter rep(out, cfg);
+    rep.report(reporter::Error(mismatch, { "a", "b" }));
+    rep.report(reporter::Error(mismatch, { "c", "d" }));
+    rep.flush();
+    CHECK(out.str() == "Error: expected 'a' but found 'b'\nError: and 1 more\n");
+    return true;
+}
+
+// templated notes are formatted wherever secondaries are printed
+static bool checkTemplatedSecondaries() {
+    static const reporter::MessageTemplate declared("'{}' declared here");
+    TempDir tmp;
+    reporter::SimpleFile file(tmp.file("a.dn", "let value = other + 1\n"));
+    auto note = [](std::string name, reporter::Location loc) {
+        return std::make_shared<const reporter::Diagnostic>(reporter::Note(declared, { name }, loc));
+    };
+    auto err = reporter::Error("e", { 1, 12, 17, &file })
+        .withShared(note("value", { 1, 4, 9, &file }))
+        .withShared(note("other", { 1, 12, 17, &file }))
+        .withShared(note("elsewhere", {}))
+        .withShared(note("sum", { 1, 4, 5, &file }));
+    for (auto style : { reporter::DisplayStyle::SHORT, reporter::DisplayStyle::RICH }) {
+        reporter::Config cfg;
+        cfg.style = style;
+        std::ostringstream out;
+        auto copy = err;
+        copy.print(out, cfg);
+        for (auto name : { "'value'", "'other'", "'elsewhere'", "'sum'" })
+            CHECK(out.str().find(std::string(name) + " declared here") != std::string::npos);
+    }
+    return true;
+}
+
+// localized names are looked up in a catalog, and lines following a wide name line up with the text after it
+static bool checkLocalization() {
+    TempDir tmp;
+    auto path = tmp.file("ja.cat", "");
+    CHECK(reporter::Catalog::compile(path, { { "reporter.note", "\u6CE8\u610F" } }));
+    reporter::Catalog catalog;
+    CHECK(catalog.open(path));
+    CHECK(catalog.lookup("reporter.note").width == 4);
+    reporter::Config cfg;
+    cfg.localize(catalog);
+    CHECK(cfg.chars.noteName == "\u6CE8\u610F");
+    reporter::SimpleFile file(tmp.file("a.dn", "let a = 1\n"));
+    std::ostringstream out;
+    reporter::Error("e", { 1, 4, 5, &file }).withNote("first\nsecond").print(out, cfg);
+    auto text = out.str();
+    auto first = text.find("\u6CE8\u610F: first\n");
+    CHECK(first != std::string::npos);
+    auto lineStart = text.rfind('\n', first) + 1;
+    // the bullet takes up one column but 3 bytes, and the name 4 columns but 6 bytes
+    auto column = first + std::strlen("\u6CE8\u610F: ") - lineStart - 2 - 2;
+    auto next = text.find('\n', first) + 1;
+    CHECK(text.substr(next, text.find('\n', next) - next) == std::string(column, ' ') + "second");
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////////////
+
+// a diagnostic reported into a file which ordered mode already moved past is still printed and counted
+static bool checkOrderedLateArrival() {
+    reporter::SimpleFile a("a.dn"), b("b.dn");
+    std::ostringstream out;
+    reporter::Reporter rep(out, shortConfig());
+    rep.order({ &b, &a });
+    rep.report(reporter::Error("first", { 3, 0, 1, &a }));
+    rep.complete(&a);
+    rep.report(reporter::Error("second", { 1, 0, 1, &b }));
+    rep.report(reporter::Error("late", { 2, 0, 1, &a }));
+    rep.flush();
+    auto text = out.str();
+    CHECK(text.find("late") != std::string::npos);
+    CHECK(text.find("first") < text.find("late"));
+    CHECK(text.find("second") != std::string::npos);
+    CHECK(rep.statistics().emitted(reporter::DiagnosticType::ERROR) == 3);
+    return true;
+}
+
+// ordered mode prints diagnostics from concurrent producers by path and line, whatever order they arrive in
+static bool checkOrderedConcurrent() {
+    const int fileCount = 8, lineCount = 200, chunk = 10;
+    std::vector<std::unique_ptr<reporter::SimpleFile>> files;
+    for (int i = 0; i < fileCount; i++)
+        files.emplace_back(new reporter::SimpleFile("ordered" + std::to_string(i) + ".dn"));
+    auto cfg = shortConfig();
+    cfg.limits.similar = 0;
+    std::ostringstream out;
+    reporter::Reporter rep(out, cfg);
+    std::vector<reporter::SourceFile*> order;
+    for (int i = fileCount - 1; i >= 0; i--)
+        order.push_back(files[i].get());
+    rep.order(order);
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++)
+        threads.emplace_back([&, t] {
+            std::mt19937 rng(t);
+            for (int f = t; f < fileCount; f += 4) {
+                auto file = files[f].get();
+                for (int first = 1; first <= lineCount; first += chunk) {
+                    std::vector<uint32_t> lines;
+                    for (int line = first; line < first + chunk; line++)
+                        lines.push_back(static_cast<uint32_t>(line));
+                    std::shuffle(lines.begin(), lines.end(), rng);
+                    for (auto line : lines)
+                        rep.report(reporter::Warning("w", { line, 0, 1, file }));
+                    rep.complete(file, static_cast<uint32_t>(first + chunk));
+                }
+                rep.complete(file);
+            }
+        });
+    for (auto& thread : threads)
+        thread.join();
+    rep.flush();
+
+    std::istringstream in(out.str());
+    std::string line;
+    for (int f = 0; f < fileCount; f++)
+        for (int l = 1; l <= lineCount; l++) {
+            CHECK(std::getline(in, line));
+            CHECK(line == files[f]->str() + ":" + std::to_string(l) + ":0:1: Warning: w");
+        }
+    CHECK(!std::getline(in, line));
+    return true;
+}
+
+// files are rewritten in parallel, keeping their mode
+static bool checkFixItApplier() {
+    const int count = 16;
+    TempDir tmp;
+    std::vector<std::unique_ptr<reporter::SimpleFile>> files;
+    reporter::FixItApplier applier;
+    for (int i = 0; i < count; i++) {
+        auto path = tmp.file("fixit" + std::to_string(i) + ".dn", "let x = 1\nlet y = x\n");
+#if defined(__unix__) || defined(__APPLE__)
+        chmod(path.c_str(), 0750);
+#endif
+        files.emplace_back(new reporter::SimpleFile(path));
+        applier.add(reporter::Error("unused", { 2, 4, 5, files.back().get() }).withFixIt({ 2, 4, 5, files.back().get() }, "_y"));
+    }
+    CHECK(applier.apply(4) == count);
+    for (auto& file : files) {
+        auto path = file->str();
+        CHECK(readAll(path) == "let x = 1\nlet _y = x\n");
+#if defined(__unix__) || defined(__APPLE__)
+        struct stat info;
+        CHECK(stat(path.c_str(), &info) == 0 && (info.st_mode & 0777) == 0750);
+#endif
+    }
+    return true;
+}
+
+// source files naming the same file share one rewrite, made to the file as it is on disk when applying
+static bool checkFixItSameFile() {
+    TempDir tmp;
+    auto path = tmp.file("same.dn", "let a = 1\nlet b = 2\n");
+    reporter::SimpleFile first(path), second(path);
+    CHECK(first.index()->line(2) == "let b = 2");
+    std::ofstream(path, std::ios::binary) << "// header\nlet a = 1\nlet b = 2\n"; // changed after the first index
+    reporter::FixItApplier applier;
+    applier.add(reporter::Error("a", { 2, 4, 5, &first }).withFixIt({ 2, 4, 5, &first }, "x"));
+    applier.add(reporter::Error("b", { 3, 4, 5, &second }).withFixIt({ 3, 4, 5, &second }, "y"));
+    CHECK(applier.apply(2) == 1);
+    CHECK(readAll(path) == "// header\nlet x = 1\nlet y = 2\n");
+    CHECK(first.index()->line(3) == "let y = 2");
+    return true;
+}
+
+// every diagnostic reported from several producers is either printed or dropped, and errors are never dropped
+static bool checkAsyncWriter() {
+    const int producers = 4, perProducer = 2000;
+    auto cfg = shortConfig();
+    cfg.limits.similar = 0;
+    for (bool drop : { false, true }) {
+        std::ostringstream out;
+        reporter::Reporter rep(out, cfg);
+        {
+            reporter::AsyncWriter writer(rep, 16, drop);
+            std::vector<std::thread> threads;
+            for (int t = 0; t < producers; t++)
+                threads.emplace_back([&writer] {
+                    for (int i = 0; i < perProducer; i++) {
+                        if (i % 4 == 0) writer.report(reporter::Error("an error"));
+                        else writer.report(reporter::Warning("a warning"));
+                    }
+                });
+            for (auto& thread : threads)
+                thread.join();
+        }
+        auto& stats = rep.statistics();
+        CHECK(stats.emitted(reporter::DiagnosticType::ERROR) == producers * perProducer / 4);
+        CHECK(stats.emitted(reporter::DiagnosticType::WARNING) + stats.dropped() == producers * perProducer * 3 / 4);
+        CHECK(drop || stats.dropped() == 0);
+    }
+    return true;
+}
+
+// codes counted from several threads add up, including codes which overflow the first table of counters
+static bool checkStatistics() {
+    const int threadCount = 4, codeCount = 300, rounds = 20;
+    reporter::Statistics stats;
+    std::vector<reporter::Diagnostic> diags;
+    for (int i = 0; i < codeCount; i++)
+        diags.push_back(reporter::Warning("w", "", "W" + std::to_string(i), {}));
+    std::vector<std::thread> threads;
+    for (int t = 0; t < threadCount; t++)
+        threads.emplace_back([&, t] {
+            for (int r = 0; r < rounds; r++)
+                for (int i = 0; i < codeCount; i++)
+                    stats.count(diags[(i + t * 37) % codeCount]);
+        });
+    for (auto& thread : threads)
+        thread.join();
+    auto codes = stats.codes();
+    CHECK(codes.size() == codeCount);
+    for (auto& code : codes)
+        CHECK(code.second == threadCount * rounds);
+    CHECK(stats.emitted(reporter::DiagnosticType::WARNING) == threadCount * rounds * codeCount);
+    return true;
+}
+
+// pooled diagnostics are recycled clean, also when released on another thread than the one which made them
+static bool checkDiagnosticPool() {
+    const int threadCount = 4, perThread = 5000;
+    std::ostringstream out;
+    reporter::Reporter rep(out, shortConfig());
+    auto expected = reporter::Warning("unused variable", "", "W101", {}).hash();
+    std::atomic<int> dirty(0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < threadCount; t++)
+        threads.emplace_back([&] {
+            std::vector<reporter::DiagnosticPool::Handle> handOff;
+            for (int i = 0; i < perThread; i++) {
+                auto diag = reporter::DiagnosticPool::make(reporter::DiagnosticType::WARNING, "unused variable", "", "W101");
+                if (diag->hash() != expected)
+                    dirty++;
+                diag->withNote("declared here");
+                rep.report(*diag);
+                if (i % 2)
+                    handOff.push_back(std::move(diag));
+            }
+            // released on another thread, into that thread's free list
+            std::thread([&handOff] { handOff.clear(); }).join();
+        });
+    for (auto& thread : threads)
+        thread.join();
+    CHECK(dirty == 0);
+    CHECK(rep.statistics().emitted(reporter::DiagnosticType::WARNING) == threadCount * perThread);
+    CHECK(reporter::DiagnosticPool::available() == 0); // the main thread released none
+    return true;
+}
+
+// a diagnostic spanning several files renders the same whether its files are read in parallel or in turn
+static bool checkReadFiles() {
+    const int count = 8;
+    TempDir tmp;
+    std::vector<std::string> paths;
+    for (int i = 0; i < count; i++)
+        paths.push_back(tmp.file("read" + std::to_string(i) + ".dn", "fn f" + std::to_string(i) + "() {\n    return " + std::to_string(i) + "\n}\n"));
+    std::string outputs[2];
+    for (int pass = 0; pass < 2; pass++) {
+        std::vector<std::unique_ptr<reporter::SimpleFile>> files;
+        for (auto& path : paths)
+            files.emplace_back(new reporter::SimpleFile(path));
+        auto err = reporter::Error("mismatched return types", "returns an integer", { 2, 11, 12, files[0].get() });
+        for (int i = 1; i < count; i++)
+            err.withNote("also returned here", { 2, 11, 12, files[i].get() });
+        reporter::Config cfg;
+        cfg.readThreads = pass ? 4 : 1;
+        std::ostringstream out;
+        err.print(out, cfg);
+        outputs[pass] = out.str();
+        for (auto& file : files)
+            CHECK(file->indexed());
+    }
+    CHECK(outputs[0] == outputs[1]);
+    CHECK(outputs[0].find("return 7") != std::string::npos);
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////////////
+
+int main() {
+    struct Check {
+        const char* name;
+        bool (*run)();
+    };
+    const Check checks[] = {
+        { "suppression", checkSuppression },
+        { "in-memory file", checkInMemoryFile },
+        { "collapse", checkCollapse },
+        { "held errors", checkHeldErrors },
+        { "elision", checkElision },
+        { "source map", checkSourceMap },
+        { "templates", checkTemplates },
+        { "templated secondaries", checkTemplatedSecondaries },
+        { "localization", checkLocalization },
+        { "ordered late arrival", checkOrderedLateArrival },
+        { "ordered concurrent", checkOrderedConcurrent },
+        { "fix-it applier", checkFixItApplier },
+        { "fix-its to the same file", checkFixItSameFile },
+        { "async writer", checkAsyncWriter },
+        { "statistics", checkStatistics },
+        { "diagnostic pool", checkDiagnosticPool },
+        { "read files", checkReadFiles },
+    };
+    int failed = 0;
+    for (auto& check : checks)
+        if (!check.run()) {
+            std::cerr << "  in " << check.name << "\n";
+            failed++;
+        }
+    std::cout << (sizeof(checks) / sizeof(*checks) - failed) << " of " << sizeof(checks) / sizeof(*checks) << " checks passed\n";
+    return failed ? 1 : 0;
+}